@@ -0,0 +1,359 @@
+// microbenchmarks for the cpu, memory bus and ppu hot paths
+//
+// every benchmark runs a fixed amount of work several times after a warmup
+// and reports the median. results go to stdout and, as json, to the file
+// given on the command line. hardware counters come from perf_event_open and
+// are reported as null when the kernel or container doesn't allow them.
+
+#include "nes.h"
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+const int REPETITIONS = 7;
+const int NUM_COUNTERS = 3;
+const char* COUNTER_NAMES[NUM_COUNTERS] = {
+  "instructions", "cache_misses", "l1d_read_misses"
+};
+
+volatile uint64_t sink; // keeps the compiler from dropping benchmark bodies
+
+class PerfCounters {
+  public:
+  int fds[NUM_COUNTERS];
+  bool available;
+
+  void initialize();
+  void start();
+  void stop(uint64_t*);
+};
+
+int open_counter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void PerfCounters::initialize() {
+  fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  fds[2] = open_counter(PERF_TYPE_HW_CACHE,
+                        PERF_COUNT_HW_CACHE_L1D |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  available = true;
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    available = available && fds[i] >= 0;
+  }
+}
+
+void PerfCounters::start() {
+  if (!available) {
+    return;
+  }
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void PerfCounters::stop(uint64_t* values) {
+  if (!available) {
+    return;
+  }
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fds[i], values + i, sizeof(uint64_t)) != sizeof(uint64_t)) {
+      values[i] = 0;
+    }
+  }
+}
+
+struct BenchResult {
+  string name;
+  uint64_t ops;
+  double ns_per_op;
+  bool has_counters;
+  double counters_per_op[NUM_COUNTERS];
+};
+
+PerfCounters counters;
+vector<BenchResult> results;
+
+// body() does `ops` operations each time it is called
+template <typename F>
+void run_benchmark(string name, uint64_t ops, F body) {
+  body(); // warmup
+  vector<double> times;
+  vector<uint64_t> values[NUM_COUNTERS];
+  for (int rep = 0; rep < REPETITIONS; ++rep) {
+    uint64_t rep_values[NUM_COUNTERS] = {0};
+    counters.start();
+    auto start = high_resolution_clock::now();
+    body();
+    auto end = high_resolution_clock::now();
+    counters.stop(rep_values);
+    times.push_back(duration_cast<nanoseconds>(end - start).count() / (double) ops);
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+      values[i].push_back(rep_values[i]);
+    }
+  }
+  BenchResult result;
+  result.name = name;
+  result.ops = ops;
+  sort(times.begin(), times.end());
+  result.ns_per_op = times[REPETITIONS / 2];
+  result.has_counters = counters.available;
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    sort(values[i].begin(), values[i].end());
+    result.counters_per_op[i] = values[i][REPETITIONS / 2] / (double) ops;
+  }
+  results.push_back(result);
+  printf("%-28s %10.2f ns/op", name.c_str(), result.ns_per_op);
+  if (result.has_counters) {
+    printf("  %8.2f ins/op  %8.4f misses/op  %8.4f l1d/op",
+           result.counters_per_op[0],
+           result.counters_per_op[1],
+           result.counters_per_op[2]);
+  }
+  printf("\n");
+}
+
+void write_json(const char* filename) {
+  FILE* out = fopen(filename, "w");
+  if (out == nullptr) {
+    printf("could not open %s\n", filename);
+    return;
+  }
+  fprintf(out, "{\n  \"repetitions\": %d,\n  \"benchmarks\": [\n", REPETITIONS);
+  for (size_t i = 0; i < results.size(); ++i) {
+    BenchResult& result = results[i];
+    fprintf(out, "    {\"name\": \"%s\", \"ops\": %lu, \"ns_per_op\": %.3f",
+            result.name.c_str(), result.ops, result.ns_per_op);
+    for (int j = 0; j < NUM_COUNTERS; ++j) {
+      if (result.has_counters) {
+        fprintf(out, ", \"%s_per_op\": %.4f", COUNTER_NAMES[j], result.counters_per_op[j]);
+      } else {
+        fprintf(out, ", \"%s_per_op\": null", COUNTER_NAMES[j]);
+      }
+    }
+    fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+  fclose(out);
+}
+
+// 32 KB of NROM program space that repeats `body` and jumps back to $8000
+uint8_t* build_program(vector<uint8_t> body) {
+  static uint8_t prg[0x8000];
+  memset(prg, 0xea, sizeof(prg));
+  int length = 0;
+  while (length + body.size() + 3 < 0x7000) {
+    copy(body.begin(), body.end(), prg + length);
+    length += body.size();
+  }
+  prg[length] = 0x4c; // JMP $8000
+  prg[length + 1] = 0x00;
+  prg[length + 2] = 0x80;
+  prg[0x7ffc] = 0x00; // reset vector
+  prg[0x7ffd] = 0x80;
+  return prg;
+}
+
+void load_bench_program(NES& nes, vector<uint8_t> body) {
+  uint8_t* prg = build_program(body);
+  nes.memory.set_prg_nrom_top(prg);
+  nes.memory.set_prg_nrom_bottom(prg + 0x4000);
+  nes.cpu.initialize();
+}
+
+void bench_dispatch(NES& nes, string name, vector<uint8_t> body) {
+  const uint64_t instructions = 1 << 20;
+  load_bench_program(nes, body);
+  run_benchmark("dispatch/" + name, instructions, [&]() {
+    for (uint64_t i = 0; i < instructions; ++i) {
+      nes.cpu.execute_instruction();
+    }
+  });
+}
+
+// many machines taking turns the way vecenv steps them, a slice of
+// instructions each, so every turn starts with the machine's state evicted
+// by the others. the misses per instruction are the lines that state spans
+void bench_interleaved(string name, vector<uint8_t> body) {
+  const int machines = 64;
+  const int slice = 256;
+  const uint64_t instructions = 1 << 20;
+  vector<NES*> nes(machines);
+  for (int i = 0; i < machines; ++i) {
+    nes[i] = new NES;
+    nes[i]->create_system();
+    load_bench_program(*nes[i], body);
+  }
+  run_benchmark("interleaved/" + name, instructions, [&]() {
+    for (uint64_t i = 0; i < instructions / slice; ++i) {
+      NES& turn = *nes[i % machines];
+      for (int j = 0; j < slice; ++j) {
+        turn.cpu.execute_instruction();
+        turn.ppu.step_to(turn.cpu.local_clock * 3);
+      }
+    }
+  });
+  for (int i = 0; i < machines; ++i) {
+    delete nes[i];
+  }
+}
+
+void bench_memory(NES& nes, string region, uint16_t base, uint16_t span) {
+  const uint64_t accesses = 1 << 22;
+  run_benchmark("read/" + region, accesses, [&]() {
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < accesses; ++i) {
+      total += nes.memory.read(base + (i & span));
+    }
+    sink = total;
+  });
+  run_benchmark("write/" + region, accesses, [&]() {
+    for (uint64_t i = 0; i < accesses; ++i) {
+      nes.memory.write(base + (i & span), i);
+    }
+  });
+}
+
+void fill_random(uint8_t* data, int size) {
+  for (int i = 0; i < size; ++i) {
+    data[i] = rand();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char* json_filename = argc > 1 ? argv[1] : "bench.json";
+  srand(1); // same data every run
+  counters.initialize();
+  if (!counters.available) {
+    printf("perf_event_open unavailable, reporting timings only\n");
+  }
+
+  NES nes;
+  nes.create_system();
+  nes.ppu.allocate_frame(); // the frame benchmarks read it
+  nes.ppu_memory.use_chr_ram(); // there's no ROM to supply pattern tables
+
+  // instruction mixes, each repeated through the program space
+  bench_dispatch(nes, "alu", {
+    0xa9, 0x35,       // LDA #$35
+    0x69, 0x17,       // ADC #$17
+    0x29, 0xf0,       // AND #$F0
+    0x45, 0x10,       // EOR $10
+    0x05, 0x11,       // ORA $11
+    0xc9, 0x40,       // CMP #$40
+    0x0a,             // ASL A
+    0x6a,             // ROR A
+    0xe8,             // INX
+    0x88,             // DEY
+    0x18,             // CLC
+    0xe9, 0x03,       // SBC #$03
+  });
+  vector<uint8_t> memory_mix = {
+    0xbd, 0x00, 0x03, // LDA $0300,X
+    0x99, 0x00, 0x04, // STA $0400,Y
+    0xb1, 0x20,       // LDA ($20),Y
+    0x95, 0x30,       // STA $30,X
+    0xe6, 0x40,       // INC $40
+    0xce, 0x00, 0x05, // DEC $0500
+    0xa1, 0x22,       // LDA ($22,X)
+    0x8d, 0x00, 0x06, // STA $0600
+    0xe8,             // INX
+    0xc8,             // INY
+  };
+  bench_dispatch(nes, "memory", memory_mix);
+  bench_dispatch(nes, "branch", {
+    0xa2, 0x04,       // LDX #$04
+    0xca,             // DEX
+    0xd0, 0xfd,       // BNE -3
+    0x20, 0x0b, 0x80, // JSR $800B (the RTS just below)
+    0x18,             // CLC
+    0x90, 0x01,       // BCC +1
+    0x60,             // RTS, skipped by the branch, reached by JSR
+  });
+  bench_dispatch(nes, "stack", {
+    0x48,             // PHA
+    0x08,             // PHP
+    0x28,             // PLP
+    0x68,             // PLA
+    0xaa,             // TAX
+    0x9a,             // TXS
+    0xba,             // TSX
+  });
+  bench_interleaved("memory", memory_mix);
+
+  // memory bus by region, wrapping within each region's span
+  bench_memory(nes, "ram", 0x0000, 0x7ff);
+  bench_memory(nes, "apu_io", 0x4000, 0x0f);
+  bench_memory(nes, "sram", 0x6000, 0x1fff);
+  bench_memory(nes, "prg", 0x8000, 0x7fff);
+  run_benchmark("read/ppu_registers", 1 << 22, [&]() {
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < (1 << 22); ++i) {
+      total += nes.memory.read(0x2000 + (i & 0x7));
+    }
+    sink = total;
+  });
+
+  run_benchmark("ppu_memory/get_pointer", 1 << 22, [&]() {
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < (1 << 22); ++i) {
+      total += *nes.ppu_memory.get_pointer(i * 0x3d);
+    }
+    sink = total;
+  });
+
+  run_benchmark("oam_dma", 1 << 16, [&]() {
+    for (int i = 0; i < (1 << 16); ++i) {
+      nes.memory.write(0x4014, i & 0x07);
+    }
+  });
+
+  // full frame, background and sprites on, random tiles and attributes
+  fill_random(nes.ppu_memory.chr_ram_data, CHR_RAM_SIZE);
+  fill_random(nes.ppu_memory.name_tables, sizeof(nes.ppu_memory.name_tables));
+  fill_random(nes.ppu_memory.palettes, sizeof(nes.ppu_memory.palettes));
+  fill_random(nes.ppu_memory.oam, sizeof(nes.ppu_memory.oam));
+  for (int i = 0; i < 0x20; ++i) {
+    nes.ppu_memory.palettes[i] &= 0x3f;
+  }
+  nes.ppu.palette_dirty = true; // written behind the PPU's back
+  nes.ppu.reg2001.reg_data.background = true;
+  nes.ppu.reg2001.reg_data.sprites = true;
+  // step_to only notices a new scanline when the dot wraps, so step in
+  // 31-dot chunks (11 per scanline) the way the cpu loop would
+  run_benchmark("ppu/frame", 64, [&]() {
+    for (int step = 0; step < 64 * 262 * 11; ++step) {
+      nes.ppu.step_to(nes.ppu.local_clock + 31);
+    }
+  });
+
+  // scaling filters on that frame, with the pool the gui would use
+  Scaler scaler;
+  for (int filter = FILTER_SCALE2X; filter < NUM_FILTERS; ++filter) {
+    scaler.set_filter((ScaleFilter) filter);
+    run_benchmark(string("scale/") + FILTER_NAMES[filter], 16, [&]() {
+      for (int i = 0; i < 16; ++i) {
+        scaler.process((uint32_t*) nes.ppu.framebuffer, nes.ppu.pixels);
+      }
+    });
+  }
+
+  write_json(json_filename);
+  printf("wrote %s\n", json_filename);
+  return 0;
+}
@@ -41,6 +41,39 @@ void CPU::print_register_values() {
           get_current_scanline());
 }
 
+// for test roms like nestest that have an automated entry point
+void CPU::set_program_counter(uint16_t address) {
+  PC = address;
+}
+
+void CPU::set_tracer(Tracer* tracer_pointer) {
+  tracer = tracer_pointer;
+}
+
+void CPU::trace_instruction() {
+  read_registers(*tracer->next_record());
+}
+
+// same state as print_register_values(), but as a binary record
+void CPU::read_registers(TraceRecord& record) {
+  // get_pointer has no side effects, unlike reading through the bus
+  uint8_t* bytes = memory->get_pointer(PC);
+  Opcode& op = opcodes[*bytes];
+  record.pc = PC;
+  record.accumulator = accumulator;
+  record.x = X;
+  record.y = Y;
+  record.flags = get_flags_as_byte();
+  record.sp = SP;
+  record.length = op.instruction_length;
+  for (int i = 0; i < 3; ++i) {
+    record.bytes[i] = i < op.instruction_length ? *memory->get_pointer(PC + i) : 0;
+  }
+  record.unused = 0;
+  record.cycle = get_current_cycle();
+  record.scanline = get_current_scanline();
+}
+
 // TODO: set B flag correctly, check if this even works
 void CPU::check_interrupt() {
   if (interrupt_type &&
@@ -71,13 +104,31 @@ void CPU::generate_nmi() {
   interrupt_type = NMI;
 }
 
+template <bool debugging>
 void CPU::execute_instruction() {
   override_pc_increment = false;
   extra_cycle_taken = false;
   check_interrupt();
-  // print_register_values();
+  if (debugging) {
+    debugger->before_instruction(); // may stop here for input
+    if (!valid) {
+      return;
+    }
+  }
+  if (tracer) {
+    trace_instruction();
+  }
+#ifdef PROFILER
+  uint16_t profiled_pc = PC;
+  uint64_t profiled_clock = local_clock;
+#endif
   run_instruction();
   increment_pc_cycles();
+  instructions++;
+#ifdef PROFILER
+  profiler->record_instruction(memory->get_pointer(profiled_pc), profiled_pc,
+                               current_opcode, local_clock - profiled_clock);
+#endif
 }
 
 void CPU::increment_pc_cycles() {
@@ -93,7 +144,7 @@ void CPU::set_ppu(PPU* ppu_pointer) {
 }
 
 void CPU::run_instruction() {
-  uint8_t opcode = memory->read(PC);
+  uint8_t opcode = memory->fetch(PC);
   current_opcode = opcodes[opcode];
   CPUFunction current_instruction = current_opcode.instruction;
 
@@ -116,29 +167,27 @@ void CPU::run_instruction() {
       return arithmetic_shift_left();
 
     case BCC:
-      return branch_on_bool(!carry);
+      return branch_on_bool(!get_carry());
 
     case BCS:
-      return branch_on_bool(carry);
+      return branch_on_bool(get_carry());
 
     case BEQ:
-      return branch_on_bool(zero);
+      return branch_on_bool(get_zero());
 
     case BIT:
       return bit();
 
     case BMI:
-      return branch_on_bool(sign);
+      return branch_on_bool(get_sign());
 
     case BNE:
-      return branch_on_bool(!zero);
+      return branch_on_bool(!get_zero());
 
     case BPL:
-      return branch_on_bool(!sign);
+      return branch_on_bool(!get_sign());
 
     case BRK:
-      // probably corrupted heap :(
-      exit(1);
       address_stack_push(PC + 2);
       b_lower = true;
       stack_push(get_flags_as_byte());
@@ -149,13 +198,13 @@ void CPU::run_instruction() {
       return;
 
     case BVC:
-      return branch_on_bool(!overflow);
+      return branch_on_bool(!get_overflow());
 
     case BVS:
-      return branch_on_bool(overflow);
+      return branch_on_bool(get_overflow());
 
     case CLC:
-      carry = false;
+      set_carry(false);
       return;
 
     case CLD:
@@ -167,7 +216,7 @@ void CPU::run_instruction() {
       return;
 
     case CLV:
-      overflow = false;
+      overflow_result = 0;
       return;
 
     case CMP:
@@ -268,7 +317,7 @@ void CPU::run_instruction() {
       return subtract_with_carry();
 
     case SEC:
-      carry = true;
+      set_carry(true);
       return;
 
     case SED:
@@ -385,9 +434,9 @@ void CPU::decrement() {
 
 void CPU::bit() {
   uint8_t value = get_operand();
-  zero = ((value & accumulator) == 0);
-  overflow = (value >> 6) & 1;
-  sign = value >= 0x80;
+  // N comes from bit 8 here, since Z and N don't describe the same value
+  nz_result = (value & accumulator) | ((value & 0x80) << 1);
+  overflow_result = value << 1;
 }
 
 void CPU::load_accumulator_x() {
@@ -442,84 +491,79 @@ void CPU::subtract_with_carry() {
 
 void CPU::add_with_carry_helper(uint8_t operand) {
   uint8_t before = accumulator;
-  uint16_t sum = accumulator + operand + carry;
-  accumulator += operand + carry;
-  zero = (accumulator == 0);
-  sign = (accumulator >= 0x80);
+  uint16_t sum = accumulator + operand + get_carry();
+  accumulator = sum;
+  nz_result = accumulator;
   // signed overflow
-  overflow = ~(operand ^ before) & (before ^ sum) & 0x80;
+  overflow_result = ~(operand ^ before) & (before ^ sum);
   // unsigned overflow
-  carry = sum > 0xff;
+  carry_result = sum;
 }
 
 uint8_t CPU::get_flags_as_byte() {
   uint8_t flags = 0;
-  flags |= (sign << 7);
-  flags |= (overflow << 6);
+  flags |= (get_sign() << 7);
+  flags |= (get_overflow() << 6);
   flags |= (b_upper << 5);
   flags |= (b_lower << 4);
   flags |= (decimal << 3);
   flags |= (interrupt_disable << 2);
-  flags |= (zero << 1);
-  flags |= carry;
+  flags |= (get_zero() << 1);
+  flags |= get_carry();
   return flags;
 }
 
 void CPU::set_flags_from_byte(uint8_t flags) {
-  carry = flags & 0x1;
-  zero = (flags >> 1) & 0x1;
+  set_carry(flags & 0x1);
+  // any nonzero low byte clears Z, bit 8 carries N
+  nz_result = ((flags & 0x80) << 1) | (~flags >> 1 & 0x1);
   interrupt_disable = (flags >> 2) & 0x1;
   decimal = (flags >> 3) & 0x1;
-  overflow = (flags >> 6) & 0x1;
-  sign = (flags >> 7) & 0x1;
+  overflow_result = flags << 1;
 }
 
 void CPU::rotate_right() {
   uint8_t value = get_operand();
-  uint8_t new_value = (carry << 7) | (value >> 1);
-  carry = value & 0x1;
-  zero = (new_value == 0);
-  sign = (new_value >= 0x80);
+  uint8_t new_value = (get_carry() << 7) | (value >> 1);
+  set_carry(value & 0x1);
+  nz_result = new_value;
   store(new_value);
 }
 
 void CPU::rotate_left() {
   uint8_t value = get_operand();
-  uint8_t new_value = (value << 1) | carry;
-  carry = (value >> 7) & 0x1;
-  zero = (new_value == 0);
-  sign = (new_value >= 0x80);
+  uint8_t new_value = (value << 1) | get_carry();
+  carry_result = value << 1;
+  nz_result = new_value;
   store(new_value);
 }
 
 void CPU::shift_right() {
   uint8_t value = get_operand();
   uint8_t new_value = value >> 1;
-  carry = value & 0x1;
-  zero = (new_value == 0);
-  sign = (new_value >= 0x80);
+  set_carry(value & 0x1);
+  nz_result = new_value;
   store(new_value);
 }
 
 void CPU::arithmetic_shift_left() {
   uint8_t value = get_operand();
   uint8_t new_value = value << 1;
-  carry = (value >> 7) & 0x1;
-  zero = (new_value == 0);
-  sign = (new_value >= 0x80);
+  carry_result = value << 1;
+  nz_result = new_value;
   store(new_value);
 }
 
 void CPU::compare(uint8_t register_value) {
   uint8_t argument_value = get_operand();
-  carry = (register_value >= argument_value);
-  zero = (register_value == argument_value);
-  sign = ((uint8_t) (register_value - argument_value)) >= 0x80;
+  // bit 8 of reg + ~arg + 1 is set exactly when reg >= arg
+  carry_result = register_value + (uint8_t) ~argument_value + 1;
+  nz_result = (uint8_t) (register_value - argument_value);
 }
 
 void CPU::jump() {
-  uint8_t arg1 = memory->read(PC + 1);
-  uint8_t arg2 = memory->read(PC + 2);
+  uint8_t arg1 = memory->fetch(PC + 1);
+  uint8_t arg2 = memory->fetch(PC + 2);
   uint16_t address = arg2 << 8 | arg1;
   override_pc_increment = true;
   if (current_opcode.addressing_mode == ABSOLUTE) {
@@ -530,8 +574,7 @@ void CPU::jump() {
 }
 
 void CPU::sign_zero_flags(uint8_t val) {
-  sign = (val >= 0x80);
-  zero = (val == 0);
+  nz_result = val;
 }
 
 void CPU::load_into_register(uint8_t* reg) {
@@ -540,7 +583,7 @@ void CPU::load_into_register(uint8_t* reg) {
 }
 
 void CPU::store(uint8_t value) {
-  uint8_t arg1 = memory->read(PC + 1);
+  uint8_t arg1 = memory->fetch(PC + 1);
   switch(current_opcode.addressing_mode) {
     case IMPLIED:
       return;
@@ -561,8 +604,8 @@ void CPU::store(uint8_t value) {
 }
 
 uint16_t CPU::get_memory_index() {
-  uint8_t arg1 = memory->read(PC + 1);
-  uint8_t arg2 = memory->read(PC + 2);
+  uint8_t arg1 = memory->fetch(PC + 1);
+  uint8_t arg2 = memory->fetch(PC + 2);
   uint16_t address = arg2 << 8 | arg1;
   switch(current_opcode.addressing_mode) {
 
@@ -593,8 +636,8 @@ uint16_t CPU::get_memory_index() {
 }
 
 uint16_t CPU::get_operand() {
-  uint8_t arg1 = memory->read(PC + 1);
-  uint8_t arg2 = memory->read(PC + 2);
+  uint8_t arg1 = memory->fetch(PC + 1);
+  uint8_t arg2 = memory->fetch(PC + 2);
   switch(current_opcode.addressing_mode) {
     case IMPLIED:
       return 0;
@@ -615,7 +658,7 @@ uint16_t CPU::get_operand() {
 
 void CPU::branch_on_bool(bool arg) {
   if (arg) {
-    uint8_t arg1 = memory->read(PC + 1);
+    uint8_t arg1 = memory->fetch(PC + 1);
     uint16_t new_pc = PC + ((int8_t) arg1) + 2;
     uint16_t original_pc_upper = (PC + 2) >> 8;
     uint16_t new_pc_upper = new_pc >> 8;
@@ -672,13 +715,47 @@ uint16_t CPU::indirect(uint8_t arg1, uint8_t arg2) {
   return address;
 }
 
+void CPU::transfer_state(SaveState& state) {
+  state.transfer(accumulator);
+  state.transfer(X);
+  state.transfer(Y);
+  state.transfer(PC);
+  state.transfer(SP);
+  state.transfer(nz_result);
+  state.transfer(carry_result);
+  state.transfer(overflow_result);
+  state.transfer(interrupt_disable);
+  state.transfer(decimal);
+  state.transfer(b_upper);
+  state.transfer(b_lower);
+  state.transfer(interrupt_type);
+  state.transfer(local_clock);
+  state.transfer(instructions);
+  state.transfer(valid);
+}
+
+// the reset button: registers are kept, and the reset sequence's three
+// suppressed pushes still move the stack pointer
+void CPU::reset() {
+  PC = memory->reset_vector();
+  SP -= 3;
+  interrupt_disable = true;
+  interrupt_type = NONE;
+}
+
 void CPU::initialize() {
   accumulator = X = Y = 0;
   PC = memory->reset_vector();
   SP = 0xfd;
+  interrupt_type = NONE;
   valid = true;
   interrupt_disable = true;
+  decimal = false;
   b_upper = true;
+  b_lower = false;
+  nz_result = 1;
+  carry_result = 0;
+  overflow_result = 0;
   OpcodeGenerator gen;
   opcodes = gen.generate_all_opcodes();
 }
@@ -1,19 +1,36 @@
 class Memory;
 class PPU;
+class Profiler;
+class Debugger;
 
-class CPU {
+// aligned, and small enough that the registers, the clock and the pointers
+// every instruction follows share two cache lines
+class alignas(64) CPU {
+  friend class Lockstep; // keeps its own copies of the registers
   public:
     void set_memory(Memory*);
     void set_ppu(PPU*);
+    void set_tracer(Tracer*);
+    void set_program_counter(uint16_t);
     uint64_t local_clock;
+    uint64_t instructions = 0; // executed since power on
 
     // handle state
     void initialize();
+    void reset();
+    void transfer_state(SaveState&);
+    // the debugger's checks only exist in execute_instruction<true>()
+    template <bool debugging = false>
     void execute_instruction();
     void generate_nmi();
 
     // for debugging only
     bool valid;
+    Debugger* debugger = nullptr;
+    void read_registers(TraceRecord&);
+#ifdef PROFILER
+    Profiler* profiler;
+#endif
 
   private:
     uint8_t accumulator;
@@ -23,18 +40,26 @@ class CPU {
     // only holds lower byte of the real SP
     uint8_t SP;
 
-    // CPU flags
-    bool carry;
-    bool zero;
+    // CPU flags. N, Z, C and V are evaluated lazily from the last result
+    // that affected them, and only turned into bools when something reads them
+    uint16_t nz_result; // Z if the low byte is 0, N if bit 7 or 8 is set
+    uint16_t carry_result; // C is bit 8
+    uint8_t overflow_result; // V is bit 7
     bool interrupt_disable;
-    bool overflow;
-    bool sign;
     bool decimal;
     bool b_upper;
     bool b_lower;
 
+    bool get_carry() { return (carry_result >> 8) & 0x1; }
+    bool get_zero() { return (nz_result & 0xff) == 0; }
+    bool get_sign() { return (nz_result & 0x180) != 0; }
+    bool get_overflow() { return overflow_result >> 7; }
+    void set_carry(bool value) { carry_result = value << 8; }
+
     // "hardware" connections
     Memory* memory;
+    PPU* ppu;
+    Opcode* opcodes;
     Interrupt interrupt_type;
 
     // keep state during execution
@@ -54,6 +79,8 @@ class CPU {
 
     // debugging
     void print_register_values();
+    void trace_instruction();
+    Tracer* tracer = nullptr; // null when tracing is off
 
     // opcode implementation
     void compare(uint8_t);
@@ -101,7 +128,5 @@ class CPU {
     void run_instruction();
     uint64_t get_current_cycle();
     uint64_t get_current_scanline();
-    Opcode* opcodes;
-    PPU* ppu;
 
 };
@@ -0,0 +1,281 @@
+Debugger::~Debugger() {
+  delete[] execute_bits;
+}
+
+void Debugger::set_cpu(CPU* cpu_pointer) {
+  cpu = cpu_pointer;
+}
+
+void Debugger::set_memory(Memory* memory_pointer) {
+  memory = memory_pointer;
+}
+
+void Debugger::initialize() {
+  OpcodeGenerator gen;
+  opcodes = gen.generate_all_opcodes();
+  breakpoints.clear();
+  break_pending = false;
+  stepping_over = false;
+  update();
+}
+
+void Debugger::request_break(const char* why) {
+  snprintf(reason, sizeof(reason), "%s", why);
+  break_pending = true;
+  update();
+}
+
+// called before every instruction while active
+void Debugger::before_instruction() {
+  TraceRecord record;
+  cpu->read_registers(record);
+  uint16_t pc = record.pc;
+  if (!break_pending && execute_bits && ((execute_bits[pc >> 3] >> (pc & 0x7)) & 0x1)) {
+    for (Breakpoint& breakpoint : breakpoints) {
+      if ((breakpoint.kind & BREAK_EXECUTE) && breakpoint.address == pc &&
+          matches(breakpoint, record)) {
+        snprintf(reason, sizeof(reason), "breakpoint at $%04X", pc);
+        break_pending = true;
+        break;
+      }
+    }
+  }
+  if (!break_pending && stepping_over && pc == step_over_return) {
+    snprintf(reason, sizeof(reason), "stepped over");
+    break_pending = true;
+  }
+  if (break_pending) {
+    break_pending = false;
+    stepping_over = false;
+    prompt(record);
+    update();
+  }
+}
+
+// from Memory's slow path, for accesses on a page with a watchpoint.
+// mirrors count, since addresses are compared by where they land
+void Debugger::check_access(uint16_t address, uint8_t value, bool write) {
+  uint8_t kind = write ? BREAK_WRITE : BREAK_READ;
+  uint8_t* target = memory->get_pointer(address);
+  for (Breakpoint& breakpoint : breakpoints) {
+    if ((breakpoint.kind & kind) && memory->get_pointer(breakpoint.address) == target) {
+      TraceRecord record;
+      cpu->read_registers(record);
+      if (matches(breakpoint, record)) {
+        if (write) {
+          snprintf(reason, sizeof(reason), "write $%02X to $%04X", value, address);
+        } else {
+          snprintf(reason, sizeof(reason), "read from $%04X", address);
+        }
+        break_pending = true; // stops after the instruction finishes
+        return;
+      }
+    }
+  }
+}
+
+bool Debugger::matches(Breakpoint& breakpoint, TraceRecord& record) {
+  uint8_t reg;
+  switch (breakpoint.reg) {
+    case 'A': reg = record.accumulator; break;
+    case 'X': reg = record.x; break;
+    case 'Y': reg = record.y; break;
+    case 'P': reg = record.flags; break;
+    case 'S': reg = record.sp; break;
+    default: return true;
+  }
+  uint8_t value = breakpoint.value;
+  switch (breakpoint.comparison) {
+    case COMPARE_EQUAL: return reg == value;
+    case COMPARE_NOT_EQUAL: return reg != value;
+    case COMPARE_LESS: return reg < value;
+    case COMPARE_GREATER: return reg > value;
+    case COMPARE_LESS_EQUAL: return reg <= value;
+    case COMPARE_GREATER_EQUAL: return reg >= value;
+    case COMPARE_AND: return (reg & value) != 0;
+    default: return true;
+  }
+}
+
+// rebuilds the execute bitmap and the watch bits in the memory map
+void Debugger::update() {
+  if (execute_bits) {
+    memset(execute_bits, 0, 0x2000);
+  }
+  for (int page = 0; page < 0x100; ++page) {
+    memory->page_traps[page] &= ~TRAP_WATCH;
+  }
+  for (Breakpoint& breakpoint : breakpoints) {
+    if (breakpoint.kind & BREAK_EXECUTE) {
+      if (execute_bits == nullptr) {
+        execute_bits = new uint8_t[0x2000]();
+      }
+      execute_bits[breakpoint.address >> 3] |= 1 << (breakpoint.address & 0x7);
+    } else {
+      uint8_t* target = memory->get_pointer(breakpoint.address);
+      for (int address = 0; address < 0x10000; ++address) {
+        if (memory->get_pointer(address) == target) {
+          memory->page_traps[address >> 8] |= TRAP_WATCH;
+        }
+      }
+    }
+  }
+  active = break_pending || stepping_over || !breakpoints.empty();
+}
+
+// "C123", "C123 A==40"
+bool Debugger::add_breakpoint(char* args, uint8_t kind) {
+  const char* operators[] = {"==", "!=", "<=", ">=", "<", ">", "&"};
+  const Comparison comparisons[] = {COMPARE_EQUAL, COMPARE_NOT_EQUAL, COMPARE_LESS_EQUAL,
+                                    COMPARE_GREATER_EQUAL, COMPARE_LESS, COMPARE_GREATER,
+                                    COMPARE_AND};
+  Breakpoint breakpoint;
+  breakpoint.kind = kind;
+  breakpoint.reg = 0;
+  breakpoint.comparison = COMPARE_ALWAYS;
+  breakpoint.value = 0;
+  char condition[16] = "";
+  unsigned int address;
+  if (sscanf(args, "%x %15s", &address, condition) < 1 || address > 0xffff) {
+    return false;
+  }
+  breakpoint.address = address;
+  if (condition[0]) {
+    breakpoint.reg = toupper(condition[0]);
+    if (!strchr("AXYPS", breakpoint.reg)) {
+      return false;
+    }
+    char* rest = condition + (breakpoint.reg == 'S' && toupper(condition[1]) == 'P' ? 2 : 1);
+    int i = 0;
+    while (i < 7 && strncmp(rest, operators[i], strlen(operators[i])) != 0) {
+      i++;
+    }
+    unsigned int value;
+    if (i == 7 || sscanf(rest + strlen(operators[i]), "%x", &value) != 1 || value > 0xff) {
+      return false;
+    }
+    breakpoint.comparison = comparisons[i];
+    breakpoint.value = value;
+  }
+  breakpoints.push_back(breakpoint);
+  update();
+  return true;
+}
+
+void Debugger::list_breakpoints() {
+  const char* operators[] = {"", "==", "!=", "<", ">", "<=", ">=", "&"};
+  for (size_t i = 0; i < breakpoints.size(); ++i) {
+    Breakpoint& breakpoint = breakpoints[i];
+    const char* kind = breakpoint.kind == BREAK_EXECUTE ? "exec" :
+      breakpoint.kind == BREAK_READ ? "read" : "write";
+    printf("%2lu  %-5s $%04X", i, kind, breakpoint.address);
+    if (breakpoint.comparison != COMPARE_ALWAYS) {
+      printf("  %c%s%02X", breakpoint.reg, operators[breakpoint.comparison], breakpoint.value);
+    }
+    printf("\n");
+  }
+}
+
+// lines instructions from start, marking the one at pc. returns the
+// address after the last one, to carry on from
+uint16_t Debugger::print_disassembly(uint16_t start, int lines, uint16_t pc) {
+  uint16_t address = start;
+  for (int i = 0; i < lines; ++i) {
+    uint8_t bytes[3];
+    for (int j = 0; j < 3; ++j) {
+      bytes[j] = *memory->get_pointer(address + j); // no side effects
+    }
+    Opcode& op = opcodes[bytes[0]];
+    char text[32], hex[10];
+    int written = 0;
+    for (int j = 0; j < op.instruction_length; ++j) {
+      written += sprintf(hex + written, j ? " %02X" : "%02X", bytes[j]);
+    }
+    disassemble(text, sizeof(text), op, address, bytes);
+    printf("%c %04X  %-9s%c%s\n", address == pc ? '>' : ' ', address, hex,
+           is_unofficial(op) ? '*' : ' ', text);
+    address += op.instruction_length;
+  }
+  return address;
+}
+
+void Debugger::print_memory(uint16_t start) {
+  for (int row = 0; row < 4; ++row) {
+    uint16_t address = start + 16 * row;
+    printf("%04X ", address);
+    for (int i = 0; i < 16; ++i) {
+      printf(" %02X", *memory->get_pointer(address + i));
+    }
+    printf("\n");
+  }
+}
+
+void Debugger::prompt(TraceRecord& record) {
+  char line[160];
+  format_trace_record(line, opcodes, record);
+  printf("%s\n%s", reason, line);
+  uint16_t listing = print_disassembly(record.pc, 6, record.pc);
+  while (true) {
+    printf("> ");
+    fflush(stdout);
+    char input[128];
+    if (fgets(input, sizeof(input), stdin) == nullptr) {
+      cpu->valid = false; // stdin closed
+      return;
+    }
+    char command[8] = "";
+    int consumed = 0;
+    sscanf(input, "%7s %n", command, &consumed);
+    char* args = input + consumed;
+    unsigned int address;
+    if (command[0] == 0 || strcmp(command, "s") == 0) {
+      request_break("step");
+      return;
+    } else if (strcmp(command, "n") == 0) {
+      if (opcodes[*memory->get_pointer(record.pc)].instruction == JSR) {
+        stepping_over = true;
+        step_over_return = record.pc + 3;
+      } else {
+        request_break("step");
+      }
+      return;
+    } else if (strcmp(command, "c") == 0) {
+      return;
+    } else if (strcmp(command, "q") == 0) {
+      cpu->valid = false;
+      return;
+    } else if (strcmp(command, "b") == 0 || strcmp(command, "br") == 0 ||
+               strcmp(command, "bw") == 0) {
+      uint8_t kind = command[1] == 'r' ? BREAK_READ : command[1] == 'w' ? BREAK_WRITE : BREAK_EXECUTE;
+      if (!add_breakpoint(args, kind)) {
+        printf("usage: %s ADDR [A|X|Y|P|SP op VALUE], op one of == != < > <= >= &\n", command);
+      }
+    } else if (strcmp(command, "bl") == 0) {
+      list_breakpoints();
+    } else if (strcmp(command, "d") == 0) {
+      size_t index;
+      if (sscanf(args, "%lu", &index) == 1 && index < breakpoints.size()) {
+        breakpoints.erase(breakpoints.begin() + index);
+      } else {
+        printf("usage: d N, see bl\n");
+      }
+    } else if (strcmp(command, "u") == 0) {
+      if (sscanf(args, "%x", &address) == 1) {
+        listing = address;
+      }
+      listing = print_disassembly(listing, 16, record.pc);
+    } else if (strcmp(command, "m") == 0 && sscanf(args, "%x", &address) == 1) {
+      print_memory(address);
+    } else if (strcmp(command, "r") == 0) {
+      format_trace_record(line, opcodes, record);
+      printf("%s", line);
+    } else {
+      printf("s / enter  step         n  step over     c  continue     q  quit\n"
+             "b ADDR [COND]  break on execute, e.g. b C123 A==40\n"
+             "br ADDR [COND] break on read      bw ADDR [COND] break on write\n"
+             "bl  list breakpoints   d N  delete one\n"
+             "u [ADDR]  disassemble  m ADDR  show memory  r  registers\n");
+    }
+    update();
+  }
+}
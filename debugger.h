@@ -0,0 +1,60 @@
+// interactive debugger on stdin
+//
+// execute breakpoints are checked by the debugging copy of
+// CPU::execute_instruction<true>, which the run loop only switches to while
+// the debugger is active. read and write watchpoints set trap bits on their
+// pages in Memory::page_traps, the same bits that already send $2000-$40FF
+// accesses down the slow path, so every other access costs what it always
+// did. with nothing set, emulation runs the exact same code as without a
+// debugger.
+
+const uint8_t BREAK_EXECUTE = 0x1;
+const uint8_t BREAK_READ = 0x2;
+const uint8_t BREAK_WRITE = 0x4;
+
+// e.g. "A==40", "X>=10", "P&02" (flag set)
+enum Comparison {COMPARE_ALWAYS, COMPARE_EQUAL, COMPARE_NOT_EQUAL,
+                 COMPARE_LESS, COMPARE_GREATER, COMPARE_LESS_EQUAL,
+                 COMPARE_GREATER_EQUAL, COMPARE_AND};
+
+struct Breakpoint {
+  uint16_t address;
+  uint8_t kind;
+  char reg; // A X Y P S
+  Comparison comparison;
+  uint8_t value;
+};
+
+class Debugger {
+  public:
+  bool active = false; // something is set, so the run loop checks
+
+  ~Debugger();
+  void set_cpu(CPU*);
+  void set_memory(Memory*);
+  void initialize();
+
+  // stop before the next instruction, e.g. from a key press
+  void request_break(const char*);
+  bool add_breakpoint(char*, uint8_t);
+  void before_instruction();
+  void check_access(uint16_t, uint8_t, bool);
+
+  private:
+  CPU* cpu;
+  Memory* memory;
+  Opcode* opcodes;
+  vector<Breakpoint> breakpoints;
+  uint8_t* execute_bits = nullptr; // one bit per address, from the first execute breakpoint on
+  bool break_pending = false;
+  char reason[64];
+  bool stepping_over = false;
+  uint16_t step_over_return;
+
+  bool matches(Breakpoint&, TraceRecord&);
+  void update();
+  void prompt(TraceRecord&);
+  void list_breakpoints();
+  uint16_t print_disassembly(uint16_t, int, uint16_t);
+  void print_memory(uint16_t);
+};
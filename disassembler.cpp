@@ -0,0 +1,69 @@
+// turns an opcode + its operand bytes into nestest-style assembly text
+
+bool is_unofficial(Opcode& op) {
+  if (op.instruction >= ISC) {
+    return true;
+  }
+  if (op.instruction == NOP) {
+    return op.opcode != 0xea;
+  }
+  return op.opcode == 0xeb; // duplicate SBC
+}
+
+bool uses_accumulator_operand(Opcode& op) {
+  return op.addressing_mode == ACCUMULATOR &&
+    (op.instruction == ASL || op.instruction == LSR ||
+     op.instruction == ROL || op.instruction == ROR);
+}
+
+// writes e.g. "LDA ($80),Y" into out, returns number of characters written
+int disassemble(char* out, int size, Opcode& op, uint16_t pc, uint8_t* bytes) {
+  const char* name = FUNCTION_NAMES[op.instruction];
+  uint8_t arg1 = bytes[1];
+  uint16_t address = (bytes[2] << 8) | arg1;
+  switch (op.addressing_mode) {
+    case IMPLIED:
+      return snprintf(out, size, "%s", name);
+
+    case ACCUMULATOR:
+      if (uses_accumulator_operand(op)) {
+        return snprintf(out, size, "%s A", name);
+      }
+      return snprintf(out, size, "%s", name);
+
+    case IMMEDIATE:
+      return snprintf(out, size, "%s #$%02X", name, arg1);
+
+    case ZERO_PAGE:
+      return snprintf(out, size, "%s $%02X", name, arg1);
+
+    case ZERO_PAGE_X:
+      return snprintf(out, size, "%s $%02X,X", name, arg1);
+
+    case ZERO_PAGE_Y:
+      return snprintf(out, size, "%s $%02X,Y", name, arg1);
+
+    case ABSOLUTE:
+      return snprintf(out, size, "%s $%04X", name, address);
+
+    case ABSOLUTE_X:
+      return snprintf(out, size, "%s $%04X,X", name, address);
+
+    case ABSOLUTE_Y:
+      return snprintf(out, size, "%s $%04X,Y", name, address);
+
+    case INDIRECT:
+      return snprintf(out, size, "%s ($%04X)", name, address);
+
+    case INDIRECT_X:
+      return snprintf(out, size, "%s ($%02X,X)", name, arg1);
+
+    case INDIRECT_Y:
+      return snprintf(out, size, "%s ($%02X),Y", name, arg1);
+
+    case RELATIVE:
+      return snprintf(out, size, "%s $%04X", name,
+                      (uint16_t) (pc + 2 + (int8_t) arg1));
+  }
+  return 0;
+}
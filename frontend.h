@@ -0,0 +1,25 @@
+// what the core needs from whatever shows frames and reads the keyboard.
+// the SDL window in gui.cpp is one; with none attached the core runs headless
+// and takes its input from movies, netplay or Memory::frame_input.
+//
+// the frontend samples the pads once per frame, while handling events, into
+// pads. the bus only ever reads that snapshot, so a game polling $4016 in a
+// loop costs nothing extra, and a frontend with its own input thread can
+// store to it from there.
+
+class Frontend {
+  public:
+  bool valid = false; // false once the window has been closed
+  atomic<uint8_t> pads[2] = {{0}, {0}}; // bit 0 A ... bit 7 right
+
+  virtual void render_frame(uint8_t*) = 0;
+  virtual void handle_events() = 0; // for frames that are skipped
+
+  // memory the next frame can be drawn straight into, which render_frame()
+  // then shows without copying it. null to have it drawn into ppu.framebuffer
+  virtual uint8_t* lock_frame() { return nullptr; }
+
+  uint8_t get_input(int port) {
+    return pads[port].load(memory_order_relaxed);
+  }
+};
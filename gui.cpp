@@ -1,40 +1,45 @@
+// SDL window and keyboard, the only part of the emulator that needs SDL.
+// it only talks to the core through libnesmerize.h; nes.cpp attaches it
+// with nesmerize_set_frontend()
 // TODO: think about apu communication with gui?
 
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
 class GUI {
   public:
-  PPU* ppu;
-  Memory* memory;
+  Nesmerize* emulator;
+  bool valid = false; // false once the window has been closed
   SDL_Window* window;
   SDL_Renderer* renderer;
   SDL_Texture* texture;
+  SDL_Texture* shown = nullptr; // what the next present() shows
+  uint8_t* locked_pixels = nullptr; // texture memory the PPU is drawing into
   SDL_Rect baselayer;
-  bool valid;
   int frames;
 
-  void set_ppu(PPU*);
-  void initialize();
-  void close_gui();
-  void render_frame(uint8_t*);
-  uint8_t get_input();
-};
+  // frame timing overlay, toggled with F1
+  bool show_overlay = false;
 
-struct InputData {
-  bool a : 1;
-  bool b : 1;
-  bool select : 1;
-  bool start : 1;
-  bool up : 1;
-  bool down : 1;
-  bool left : 1;
-  bool right : 1;
-};
+  // scaling filter, cycled with F2
+  SDL_Texture* scaled_texture = nullptr;
+  int scaled_width = 0;
 
-union Input {
-  uint8_t value;
-  InputData data;
+  void initialize(Nesmerize*);
+  void close_gui();
+  NesmerizeFrontend callbacks();
+  void upload(const uint8_t*, int, int);
+  void present();
+  bool handle_events();
+  uint8_t* lock_frame();
+  void draw_overlay();
+  void poll_input();
 };
 
-void GUI::initialize() {
+const int OVERLAY_TITLE_FRAMES = 30;
+
+void GUI::initialize(Nesmerize* emulator_instance) {
+  emulator = emulator_instance;
   SDL_Init(SDL_INIT_VIDEO || SDL_INIT_AUDIO);
 	// Create window
 	window = SDL_CreateWindow(
@@ -83,56 +88,180 @@ void GUI::close_gui() {
   valid = false;
 }
 
-uint8_t GUI::get_input() {
-  Input input_data;
-  input_data.value = 0;
-  SDL_PumpEvents(); // update event queue to avoid being a frame behind
-  const uint8_t* keystate = SDL_GetKeyboardState(NULL);
+// pad 1 on the arrows, Z, X, right shift and return, pad 2 on WASD, G, F,
+// Q and E
+const SDL_Scancode PAD_KEYS[2][8] = {
+  {SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_RSHIFT, SDL_SCANCODE_RETURN,
+   SDL_SCANCODE_UP, SDL_SCANCODE_DOWN, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT},
+  {SDL_SCANCODE_G, SDL_SCANCODE_F, SDL_SCANCODE_Q, SDL_SCANCODE_E,
+   SDL_SCANCODE_W, SDL_SCANCODE_S, SDL_SCANCODE_A, SDL_SCANCODE_D},
+};
 
-  // update bitfield with information about keyboard
-  if (keystate[SDL_SCANCODE_DOWN]) {
-    input_data.data.down = 1;
-  }
-  if (keystate[SDL_SCANCODE_UP]) {
-    input_data.data.up = 1;
-  }
-  if (keystate[SDL_SCANCODE_RIGHT]) {
-    input_data.data.right = 1;
-  }
-  if (keystate[SDL_SCANCODE_LEFT]) {
-    input_data.data.left = 1;
-  }
-  if (keystate[SDL_SCANCODE_Z]) {
-    input_data.data.a = 1;
-  }
-  if (keystate[SDL_SCANCODE_X]) {
-    input_data.data.b = 1;
-  }
-  if (keystate[SDL_SCANCODE_RSHIFT]) {
-    input_data.data.select = 1;
-  }
-  if (keystate[SDL_SCANCODE_RETURN]) {
-    input_data.data.start = 1;
+// once per frame, after the event queue has been pumped
+void GUI::poll_input() {
+  const uint8_t* keystate = SDL_GetKeyboardState(NULL);
+  for (int port = 0; port < 2; ++port) {
+    uint8_t buttons = 0; // bit 0 A, B, select, start, up, down, left, bit 7 right
+    for (int button = 0; button < 8; ++button) {
+      if (keystate[PAD_KEYS[port][button]]) {
+        buttons |= 1 << button;
+      }
+    }
+    nesmerize_set_input(emulator, port, buttons);
   }
+}
 
-  return input_data.value;
+// how the core reaches the window
+NesmerizeFrontend GUI::callbacks() {
+  NesmerizeFrontend frontend;
+  frontend.user = this;
+  frontend.upload = [](void* gui, const uint8_t* frame, int width, int height) {
+    ((GUI*) gui)->upload(frame, width, height);
+  };
+  frontend.present = [](void* gui) {
+    ((GUI*) gui)->present();
+  };
+  frontend.poll = [](void* gui) {
+    return (int) ((GUI*) gui)->handle_events();
+  };
+  frontend.lock_frame = [](void* gui) {
+    return ((GUI*) gui)->lock_frame();
+  };
+  return frontend;
 }
 
 // TODO: why does this work at 60fps even without vsync or anything?
-void GUI::render_frame(uint8_t* framebuffer) {
+void GUI::present() {
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xff);
+  SDL_RenderClear(renderer);
+  SDL_RenderCopy(renderer, shown, nullptr, nullptr);
+  if (show_overlay) {
+    draw_overlay();
+  }
+	SDL_RenderPresent(renderer);
+  frames++;
+}
+
+// every frame, shown or skipped, so the window and keys stay live
+bool GUI::handle_events() {
 	SDL_Event e;
 
 	while (SDL_PollEvent(&e) != 0) {
 		if (e.type == SDL_QUIT) {
       close_gui();
-			return;
+			return false;
 		}
+    if (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_F2) {
+      const char* current = nesmerize_filter(emulator);
+      int filter = 0;
+      while (strcmp(nesmerize_filter_name(filter), current) != 0) {
+        filter++;
+      }
+      const char* next = nesmerize_filter_name(filter + 1);
+      next = next ? next : nesmerize_filter_name(0);
+      nesmerize_set_filter(emulator, next);
+      cout << "filter: " << next << "\n";
+    }
+    if (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_F3) {
+      nesmerize_request_break(emulator);
+    }
+    if (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_F1) {
+      show_overlay = !show_overlay;
+      if (!show_overlay) {
+        SDL_SetWindowTitle(window, "NESmerize");
+      }
+    }
 	}
-  // update with new frame data
-  SDL_UpdateTexture(texture, nullptr, framebuffer, 256 * 4);
-  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xff);
-  SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-	SDL_RenderPresent(renderer);
-  frames++;
+  poll_input();
+  return valid;
+}
+
+// the streaming texture's own memory, so a frame drawn there needs no
+// SDL_UpdateTexture copy
+uint8_t* GUI::lock_frame() {
+  if (!valid) {
+    return nullptr;
+  }
+  if (locked_pixels == nullptr) {
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch) != 0) {
+      return nullptr;
+    }
+    if (pitch != 256 * 4) {
+      SDL_UnlockTexture(texture);
+      return nullptr;
+    }
+    locked_pixels = (uint8_t*) pixels;
+  }
+  return locked_pixels;
+}
+
+// picks the texture to show: the one the frame was drawn into, one the
+// size of a scaled frame, or the usual one with the frame copied in
+void GUI::upload(const uint8_t* frame, int width, int height) {
+  if (locked_pixels) {
+    bool direct = frame == locked_pixels;
+    SDL_UnlockTexture(texture);
+    locked_pixels = nullptr;
+    if (direct) {
+      shown = texture;
+      return;
+    }
+  }
+  if (width != 256) {
+    if (scaled_texture == nullptr || scaled_width != width) {
+      if (scaled_texture) {
+        SDL_DestroyTexture(scaled_texture);
+      }
+      scaled_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                         SDL_TEXTUREACCESS_STREAMING, width, height);
+      scaled_width = width;
+    }
+    SDL_UpdateTexture(scaled_texture, nullptr, frame, width * 4);
+    shown = scaled_texture;
+    return;
+  }
+  SDL_UpdateTexture(texture, nullptr, frame, 256 * 4);
+  shown = texture;
+}
+
+// one bar per stage of the previous frame, scaled so the full width is one
+// NTSC frame, with a tick at the p99 frame time. numbers go in the title.
+const double OVERLAY_FRAME_MS = 1000 / 60.0988;
+
+void GUI::draw_overlay() {
+  const uint8_t colors[4][3] = {
+    {0x40, 0xc0, 0x40}, // emulation
+    {0x40, 0x80, 0xff}, // render
+    {0xff, 0xc0, 0x40}, // upload
+    {0xff, 0x40, 0x40}, // present
+  };
+  NesmerizeTiming timing;
+  nesmerize_frame_timing(emulator, &timing);
+  double durations[4] = {timing.emulation_ms, timing.render_ms, timing.upload_ms,
+                         timing.present_ms};
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xa0);
+  SDL_Rect background = {0, 0, 256, 4 * 4 + 2};
+  SDL_RenderFillRect(renderer, &background);
+  for (int i = 0; i < 4; ++i) {
+    SDL_Rect bar = {1, 1 + 4 * i, (int) (254 * durations[i] / OVERLAY_FRAME_MS), 3};
+    SDL_SetRenderDrawColor(renderer, colors[i][0], colors[i][1], colors[i][2], 0xff);
+    SDL_RenderFillRect(renderer, &bar);
+  }
+  int p99_x = 1 + (int) (254 * timing.p99_ms / OVERLAY_FRAME_MS);
+  SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
+  SDL_RenderDrawLine(renderer, p99_x, 0, p99_x, background.h);
+
+  if (frames % OVERLAY_TITLE_FRAMES == 0) {
+    char title[128];
+    snprintf(title, sizeof(title),
+             "NESmerize - %.2fx, p50 %.1f ms, p99 %.1f ms, max %.1f ms, %lu ins",
+             timing.speed_ratio,
+             timing.p50_ms,
+             timing.p99_ms,
+             timing.max_ms,
+             timing.instructions);
+    SDL_SetWindowTitle(window, title);
+  }
 }
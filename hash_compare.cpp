@@ -0,0 +1,77 @@
+// compares two hash logs written with --hash-log and reports the first
+// frame where they diverge, e.g.
+//   frame 1234: state differs (framebuffer matches), 29781 vs 29790 instructions
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hashlog.cpp"
+
+const int RECORDS_PER_READ = 4096;
+
+FILE* open_log(const char* filename, HashLogHeader& header) {
+  FILE* in = fopen(filename, "rb");
+  if (in == nullptr) {
+    printf("could not open %s\n", filename);
+    return nullptr;
+  }
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, HASHLOG_MAGIC, 4) != 0 ||
+      header.version != HASHLOG_VERSION ||
+      header.record_size != sizeof(HashRecord)) {
+    printf("%s is not a version %d hash log\n", filename, HASHLOG_VERSION);
+    fclose(in);
+    return nullptr;
+  }
+  return in;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: hashcompare.out a.hashes b.hashes\n");
+    return 2;
+  }
+  HashLogHeader header_a, header_b;
+  FILE* a = open_log(argv[1], header_a);
+  FILE* b = open_log(argv[2], header_b);
+  if (a == nullptr || b == nullptr) {
+    return 2;
+  }
+  if (header_a.rom_hash != header_b.rom_hash) {
+    printf("warning: the logs are from different ROMs\n");
+  }
+
+  static HashRecord records_a[RECORDS_PER_READ];
+  static HashRecord records_b[RECORDS_PER_READ];
+  uint64_t compared = 0;
+  while (true) {
+    size_t count_a = fread(records_a, sizeof(HashRecord), RECORDS_PER_READ, a);
+    size_t count_b = fread(records_b, sizeof(HashRecord), RECORDS_PER_READ, b);
+    size_t count = count_a < count_b ? count_a : count_b;
+    for (size_t i = 0; i < count; ++i) {
+      HashRecord& x = records_a[i];
+      HashRecord& y = records_b[i];
+      bool state = x.state != y.state;
+      bool framebuffer = x.framebuffer != y.framebuffer;
+      if (state || framebuffer) {
+        printf("frame %u: %s differs (%s), %u vs %u instructions\n", x.frame,
+               state ? "state" : "framebuffer",
+               state ? (framebuffer ? "framebuffer too" : "framebuffer matches") : "state matches",
+               x.instructions, y.instructions);
+        return 1;
+      }
+    }
+    compared += count;
+    if (count_a != count_b) {
+      printf("identical for %lu frames, then %s ends\n", compared,
+             count_a < count_b ? argv[1] : argv[2]);
+      return 1;
+    }
+    if (count == 0) {
+      break;
+    }
+  }
+  printf("identical, %lu frames\n", compared);
+  return 0;
+}
@@ -0,0 +1,128 @@
+// per-frame hash log
+//
+// with a log open, every frame appends the hash of the framebuffer and of
+// the full machine state (everything save_state() writes). two logs of the
+// same ROM and input, from different builds or machines, should match frame
+// for frame; hash_compare.cpp reports the first frame where they don't.
+// the hash is XXH64, whose four independent lanes keep it near memory speed.
+//
+// layout, little endian: HashLogHeader, then one HashRecord per frame
+
+const char HASHLOG_MAGIC[4] = {'N', 'H', 'S', 'H'};
+const uint16_t HASHLOG_VERSION = 2;
+
+struct HashLogHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t record_size;
+  uint64_t rom_hash;
+};
+
+struct HashRecord {
+  uint32_t frame;
+  uint32_t instructions; // in the frame, to help tell where it went wrong
+  uint64_t framebuffer;
+  uint64_t state;
+};
+
+static_assert(sizeof(HashRecord) == 24, "hash records must stay 24 bytes");
+
+const uint64_t XXH_PRIME1 = 11400714785074694791ULL;
+const uint64_t XXH_PRIME2 = 14029467366897019727ULL;
+const uint64_t XXH_PRIME3 = 1609587929392839161ULL;
+const uint64_t XXH_PRIME4 = 9650029242287828579ULL;
+const uint64_t XXH_PRIME5 = 2870177450012600261ULL;
+
+inline uint64_t rotate_left(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t read64(const uint8_t* bytes) {
+  uint64_t value;
+  memcpy(&value, bytes, 8);
+  return value;
+}
+
+inline uint64_t xxh_round(uint64_t accumulator, uint64_t input) {
+  accumulator += input * XXH_PRIME2;
+  return rotate_left(accumulator, 31) * XXH_PRIME1;
+}
+
+inline uint64_t xxh_merge(uint64_t hash, uint64_t lane) {
+  hash ^= xxh_round(0, lane);
+  return hash * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t xxhash64(const uint8_t* data, size_t size, uint64_t seed = 0) {
+  const uint8_t* end = data + size;
+  uint64_t hash;
+  if (size >= 32) {
+    uint64_t lanes[4] = {
+      seed + XXH_PRIME1 + XXH_PRIME2, seed + XXH_PRIME2, seed, seed - XXH_PRIME1
+    };
+    for (; data + 32 <= end; data += 32) {
+      for (int i = 0; i < 4; ++i) {
+        lanes[i] = xxh_round(lanes[i], read64(data + 8 * i));
+      }
+    }
+    hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) +
+      rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+    for (int i = 0; i < 4; ++i) {
+      hash = xxh_merge(hash, lanes[i]);
+    }
+  } else {
+    hash = seed + XXH_PRIME5;
+  }
+  hash += size;
+  for (; data + 8 <= end; data += 8) {
+    hash ^= xxh_round(0, read64(data));
+    hash = rotate_left(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+  }
+  if (data + 4 <= end) {
+    uint32_t word;
+    memcpy(&word, data, 4);
+    hash ^= word * XXH_PRIME1;
+    hash = rotate_left(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+    data += 4;
+  }
+  for (; data < end; ++data) {
+    hash ^= *data * XXH_PRIME5;
+    hash = rotate_left(hash, 11) * XXH_PRIME1;
+  }
+  hash ^= hash >> 33;
+  hash *= XXH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= XXH_PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+class HashLog {
+  public:
+  FILE* file = nullptr;
+
+  bool open(const char* filename, uint64_t rom_hash) {
+    file = fopen(filename, "wb");
+    if (file == nullptr) {
+      return false;
+    }
+    HashLogHeader header;
+    memcpy(header.magic, HASHLOG_MAGIC, 4);
+    header.version = HASHLOG_VERSION;
+    header.record_size = sizeof(HashRecord);
+    header.rom_hash = rom_hash;
+    fwrite(&header, sizeof(header), 1, file);
+    return true;
+  }
+
+  void close() {
+    if (file) {
+      fclose(file);
+      file = nullptr;
+    }
+  }
+
+  void write(HashRecord& record) {
+    fwrite(&record, sizeof(record), 1, file);
+  }
+};
@@ -0,0 +1,356 @@
+// the C interface in libnesmerize.h, a thin layer over NES. the emulator's
+// own main() in nes.cpp is a client of it too, with gui.cpp's window
+// attached through nesmerize_set_frontend().
+
+#include "nes.h"
+#include "libnesmerize.h"
+
+// the callbacks given to nesmerize_set_frontend(), as the core sees a
+// frontend. it also holds the pads, so input set through the API reaches
+// the bus the way a window's keys do, with a window or without
+class CallbackFrontend : public Frontend {
+  public:
+  NesmerizeFrontend callbacks = {};
+  Scaler* scaler = nullptr; // the NES's, once a filter has been set
+  FrameTimer* timing;
+
+  void render_frame(uint8_t*) override;
+  void handle_events() override;
+  uint8_t* lock_frame() override;
+};
+
+// the scaler's newest output when a filter is on, which is a frame behind
+void CallbackFrontend::render_frame(uint8_t* framebuffer) {
+  handle_events();
+  if (!valid) {
+    return;
+  }
+  {
+    ScopedTimer timer(timing, STAGE_UPLOAD);
+    uint32_t* scaled = nullptr;
+    if (scaler && scaler->filter != FILTER_NONE) {
+      scaler->submit(framebuffer);
+      scaled = scaler->latest();
+    }
+    if (scaled) {
+      int size = scaler->scale();
+      callbacks.upload(callbacks.user, (uint8_t*) scaled, 256 * size, 240 * size);
+    } else {
+      callbacks.upload(callbacks.user, framebuffer, 256, 240);
+    }
+  }
+  ScopedTimer timer(timing, STAGE_PRESENT);
+  callbacks.present(callbacks.user);
+}
+
+void CallbackFrontend::handle_events() {
+  valid = callbacks.poll == nullptr || callbacks.poll(callbacks.user);
+}
+
+// filters read the frame back, so they don't get one drawn into the window
+uint8_t* CallbackFrontend::lock_frame() {
+  if (!valid || callbacks.lock_frame == nullptr || (scaler && scaler->filter != FILTER_NONE)) {
+    return nullptr;
+  }
+  return callbacks.lock_frame(callbacks.user);
+}
+
+struct Nesmerize {
+  NES nes;
+  CallbackFrontend frontend;
+  SaveState state; // reused by save and load
+  size_t state_size = 0; // fixed per ROM, once it's known whether it has CHR RAM
+  bool loaded = false;
+  string path; // of the ROM file, which names the profile
+  StateCache state_cache;
+  bool cache_open = false;
+  string movie_path; // where finish saves a recording
+  string timing_prefix;
+};
+
+extern "C" {
+
+int nesmerize_api_version() {
+  return NESMERIZE_API_VERSION;
+}
+
+Nesmerize* nesmerize_create() {
+  Nesmerize* instance = new Nesmerize;
+  instance->nes.create_system();
+  instance->nes.ppu.allocate_frame(); // handed out by nesmerize_framebuffer()
+  instance->frontend.timing = &instance->nes.timing;
+  instance->nes.memory.set_frontend(&instance->frontend);
+  return instance;
+}
+
+void nesmerize_destroy(Nesmerize* instance) {
+  delete instance;
+}
+
+int nesmerize_load_rom(Nesmerize* instance, const uint8_t* data, size_t size) {
+  if (!instance->nes.load_rom(data, size)) {
+    return 0;
+  }
+  instance->loaded = true;
+  instance->state_size = 0;
+  return 1;
+}
+
+int nesmerize_running(Nesmerize* instance) {
+  return instance->loaded && instance->nes.cpu.valid;
+}
+
+void nesmerize_run_frame(Nesmerize* instance) {
+  if (instance->loaded) {
+    instance->nes.run_frame();
+  }
+}
+
+uint64_t nesmerize_run_cycles(Nesmerize* instance, uint64_t cycles) {
+  if (!instance->loaded) {
+    return 0;
+  }
+  uint64_t start = instance->nes.cpu.local_clock;
+  instance->nes.run_cycles(cycles);
+  return instance->nes.cpu.local_clock - start;
+}
+
+void nesmerize_set_input(Nesmerize* instance, int port, uint8_t buttons) {
+  if (port == 0 || port == 1) {
+    instance->frontend.pads[port].store(buttons, memory_order_relaxed);
+  }
+}
+
+const uint8_t* nesmerize_framebuffer(Nesmerize* instance) {
+  return instance->nes.ppu.framebuffer;
+}
+
+uint8_t* nesmerize_ram(Nesmerize* instance) {
+  return instance->nes.memory.internal_ram;
+}
+
+const int16_t* nesmerize_audio(Nesmerize*, size_t* samples) {
+  *samples = 0;
+  return nullptr;
+}
+
+size_t nesmerize_state_size(Nesmerize* instance) {
+  if (instance->state_size == 0) {
+    instance->nes.save_state(instance->state);
+    instance->state_size = instance->state.data.size();
+  }
+  return instance->state_size;
+}
+
+size_t nesmerize_save_state(Nesmerize* instance, uint8_t* buffer, size_t size) {
+  SaveState& state = instance->state;
+  instance->nes.save_state(state);
+  if (size < state.data.size()) {
+    return 0;
+  }
+  memcpy(buffer, state.data.data(), state.data.size());
+  return state.data.size();
+}
+
+int nesmerize_load_state(Nesmerize* instance, const uint8_t* buffer, size_t size) {
+  if (!instance->loaded || size != nesmerize_state_size(instance)) {
+    return 0;
+  }
+  SaveState& state = instance->state;
+  state.data.assign(buffer, buffer + size);
+  instance->nes.load_state(state);
+  return 1;
+}
+
+int nesmerize_load_file(Nesmerize* instance, const char* path) {
+  if (!instance->nes.load_program(path)) {
+    return 0;
+  }
+  instance->loaded = true;
+  instance->state_size = 0;
+  instance->path = path;
+  return 1;
+}
+
+void nesmerize_set_frontend(Nesmerize* instance, const NesmerizeFrontend* callbacks) {
+  CallbackFrontend& frontend = instance->frontend;
+  frontend.callbacks = callbacks ? *callbacks : NesmerizeFrontend{};
+  frontend.valid = callbacks != nullptr;
+  instance->nes.set_frontend(callbacks ? &frontend : nullptr);
+  instance->nes.memory.set_frontend(&frontend); // the pads, either way
+}
+
+void nesmerize_run(Nesmerize* instance, uint32_t frames) {
+  if (instance->loaded) {
+    instance->nes.run_game(frames);
+  }
+}
+
+void nesmerize_finish(Nesmerize* instance) {
+  NES& nes = instance->nes;
+  nes.stop_tracing();
+  nes.hash_log.close();
+  if (nes.recorder && nes.recorder->active) {
+    nes.recorder->close();
+    cout << "recorded " << nes.recorder->frames_written << " frames, dropped "
+         << nes.recorder->frames_dropped << "\n";
+  }
+  if (nes.netplay && nes.netplay->active) {
+    cout << "netplay: " << nes.netplay->rollbacks << " rollbacks, "
+         << nes.netplay->resimulated_frames << " frames re-run\n";
+    nes.netplay->close();
+  }
+  if (!instance->movie_path.empty()) {
+    nes.movie.save(instance->movie_path.c_str());
+    instance->movie_path.clear();
+  }
+  if (instance->cache_open) {
+    StateCache& cache = instance->state_cache;
+    cout << "state cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+         << cache.stored << " stored, " << cache.evicted << " evicted\n";
+  }
+  if (!instance->timing_prefix.empty()) {
+    nes.timing.close(); // writes the last summary
+    instance->timing_prefix.clear();
+  }
+#ifdef PROFILER
+  if (instance->loaded) {
+    nes.write_profile(instance->path.c_str());
+  }
+#endif
+}
+
+int nesmerize_set_filter(Nesmerize* instance, const char* name) {
+  if (!name) {
+    return 0;
+  }
+  NES& nes = instance->nes;
+  for (int filter = 0; filter < NUM_FILTERS; ++filter) {
+    if (strcmp(FILTER_NAMES[filter], name) == 0) {
+      if (nes.scaler == nullptr) {
+        if (filter == FILTER_NONE) {
+          return 1;
+        }
+        nes.scaler = new Scaler; // its threads start with the first filter
+        nes.scaler->indices = nes.ppu.pixels;
+        instance->frontend.scaler = nes.scaler;
+      }
+      nes.scaler->set_filter((ScaleFilter) filter);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+const char* nesmerize_filter(Nesmerize* instance) {
+  Scaler* scaler = instance->nes.scaler;
+  return FILTER_NAMES[scaler ? scaler->filter : FILTER_NONE];
+}
+
+const char* nesmerize_filter_name(int index) {
+  return index >= 0 && index < NUM_FILTERS ? FILTER_NAMES[index] : nullptr;
+}
+
+void nesmerize_set_frameskip(Nesmerize* instance, int frames) {
+  FrameSkip& frame_skip = instance->nes.frame_skip;
+  if (frames == NESMERIZE_SKIP_AUTO) {
+    frame_skip.start(FRAMESKIP_AUTO, 0);
+  } else if (frames == NESMERIZE_SKIP_ALL) {
+    frame_skip.start(FRAMESKIP_ALL, 0);
+  } else {
+    frame_skip.start(FRAMESKIP_FIXED, max(frames, 0));
+  }
+}
+
+int nesmerize_add_breakpoint(Nesmerize* instance, const char* address) {
+  string spec = address; // the parser wants it writable
+  return instance->nes.debugger.add_breakpoint(&spec[0], BREAK_EXECUTE);
+}
+
+void nesmerize_request_break(Nesmerize* instance) {
+  instance->nes.debugger.request_break("break");
+}
+
+int nesmerize_open_state_cache(Nesmerize* instance, const char* directory) {
+  if (!instance->state_cache.open(directory)) {
+    return 0;
+  }
+  instance->cache_open = true;
+  instance->nes.state_cache = &instance->state_cache;
+  return 1;
+}
+
+int nesmerize_record_movie(Nesmerize* instance, const char* path) {
+  instance->nes.start_recording();
+  instance->movie_path = path;
+  return 1;
+}
+
+int nesmerize_play_movie(Nesmerize* instance, const char* path) {
+  return instance->nes.start_playback(path);
+}
+
+int nesmerize_seek_movie(Nesmerize* instance, uint32_t frame) {
+  return instance->nes.seek_movie(frame);
+}
+
+uint32_t nesmerize_resume_movie(Nesmerize* instance, uint32_t last_frame) {
+  return instance->nes.resume_movie(last_frame);
+}
+
+int nesmerize_start_netplay(Nesmerize* instance, int player, int local_port, int remote_port,
+                            int latency_ms, double loss) {
+  NES& nes = instance->nes;
+  if (player < 1 || player > 2 || !nes.start_netplay(player - 1, local_port, remote_port)) {
+    return 0;
+  }
+  nes.netplay->latency_ms = latency_ms;
+  nes.netplay->loss = loss;
+  return 1;
+}
+
+int nesmerize_start_trace(Nesmerize* instance, const char* path) {
+  return instance->nes.start_tracing(path);
+}
+
+int nesmerize_record_video(Nesmerize* instance, const char* video, const char* audio) {
+  NES& nes = instance->nes;
+  if (nes.recorder == nullptr) {
+    nes.recorder = new Recorder;
+  }
+  Recorder& recorder = *nes.recorder;
+  if ((video && !recorder.open_video(video)) || (audio && !recorder.open_audio(audio))) {
+    return 0;
+  }
+  recorder.start();
+  return 1;
+}
+
+int nesmerize_start_hash_log(Nesmerize* instance, const char* path) {
+  return instance->nes.start_hash_log(path);
+}
+
+int nesmerize_start_timing_log(Nesmerize* instance, const char* prefix) {
+  if (!instance->nes.timing.open_csv((string(prefix) + ".csv").c_str())) {
+    return 0;
+  }
+  instance->nes.timing.open_summary((string(prefix) + ".json").c_str());
+  instance->timing_prefix = prefix;
+  return 1;
+}
+
+void nesmerize_frame_timing(Nesmerize* instance, NesmerizeTiming* out) {
+  FrameTimer& timing = instance->nes.timing;
+  FrameStats& stats = timing.last_frame;
+  out->emulation_ms = stats.emulation_ns / 1e6;
+  out->render_ms = stats.stage_ns[STAGE_RENDER] / 1e6;
+  out->upload_ms = stats.stage_ns[STAGE_UPLOAD] / 1e6;
+  out->present_ms = stats.stage_ns[STAGE_PRESENT] / 1e6;
+  out->speed_ratio = stats.speed_ratio;
+  out->p50_ms = timing.percentile(0.5) / 1e6;
+  out->p99_ms = timing.percentile(0.99) / 1e6;
+  out->max_ms = timing.max_frame_ns / 1e6;
+  out->instructions = stats.instructions;
+}
+
+}
@@ -0,0 +1,163 @@
+// C interface to the emulator core, for embedding it in other programs or
+// calling it from other languages. no SDL: nothing here opens a window or
+// reads the keyboard. `make lib` builds libnesmerize.a and libnesmerize.so.
+//
+// instances are independent, so different ones may run on different threads.
+// controller bytes are bit 0 A, 1 B, 2 select, 3 start, 4 up, 5 down,
+// 6 left, 7 right. the framebuffer is 256x240 BGRA, rewritten in place by
+// each drawn frame.
+//
+// calls added later bump NESMERIZE_API_VERSION; existing ones keep their
+// signatures and meaning. version 2 added everything from nesmerize_load_file
+// on, which is what nes.cpp's main() uses to run the emulator in a window.
+
+#ifndef LIBNESMERIZE_H
+#define LIBNESMERIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NESMERIZE_API_VERSION 2
+
+#define NESMERIZE_WIDTH 256
+#define NESMERIZE_HEIGHT 240
+#define NESMERIZE_FRAME_BYTES (NESMERIZE_WIDTH * NESMERIZE_HEIGHT * 4)
+#define NESMERIZE_RAM_BYTES 0x800
+
+#ifdef __GNUC__
+#define NESMERIZE_API __attribute__((visibility("default")))
+#else
+#define NESMERIZE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Nesmerize Nesmerize;
+
+// the version the library was built with, to check against the header
+NESMERIZE_API int nesmerize_api_version(void);
+
+NESMERIZE_API Nesmerize* nesmerize_create(void);
+NESMERIZE_API void nesmerize_destroy(Nesmerize*);
+
+// an iNES image, copied. 0 if it isn't one or uses an unsupported mapper
+NESMERIZE_API int nesmerize_load_rom(Nesmerize*, const uint8_t* data, size_t size);
+
+// 0 once the cpu has hit an opcode it can't run
+NESMERIZE_API int nesmerize_running(Nesmerize*);
+
+// run_frame stops after the next finished frame. run_cycles runs at least
+// that many cpu cycles, and returns how many it ran
+NESMERIZE_API void nesmerize_run_frame(Nesmerize*);
+NESMERIZE_API uint64_t nesmerize_run_cycles(Nesmerize*, uint64_t cycles);
+
+// port 0 or 1, held until changed
+NESMERIZE_API void nesmerize_set_input(Nesmerize*, int port, uint8_t buttons);
+
+// valid until the instance is destroyed
+NESMERIZE_API const uint8_t* nesmerize_framebuffer(Nesmerize*);
+NESMERIZE_API uint8_t* nesmerize_ram(Nesmerize*);
+
+// 16-bit mono samples since the last call. there is no APU yet, so this
+// is always empty
+NESMERIZE_API const int16_t* nesmerize_audio(Nesmerize*, size_t* samples);
+
+// states hold everything but the framebuffer, and only load into an
+// instance running the same ROM. save returns the bytes written, 0 if the
+// buffer is smaller than state_size
+NESMERIZE_API size_t nesmerize_state_size(Nesmerize*);
+NESMERIZE_API size_t nesmerize_save_state(Nesmerize*, uint8_t* buffer, size_t size);
+NESMERIZE_API int nesmerize_load_state(Nesmerize*, const uint8_t* buffer, size_t size);
+
+// version 2: the emulator as a program, with a window and the tooling. the
+// starting calls go after load_file, and before the first frame where a
+// recording or netplay has to begin at power on. the ones returning int
+// return 0 on failure
+
+// a ROM file, and the name the profiler's reports are written under
+NESMERIZE_API int nesmerize_load_file(Nesmerize*, const char* path);
+
+// something to show frames in, copied; null goes back to headless. upload
+// gets each shown frame, width x height BGRA (larger than 256x240 with a
+// scaling filter on), and present shows it. poll runs every frame, shown or
+// skipped, handles events and reads the pads into nesmerize_set_input(); it
+// returns 0 once the window is closed. lock_frame may be null, or return
+// 256x240 BGRA memory the next frame can be drawn straight into, which
+// upload then gets back
+typedef struct NesmerizeFrontend {
+  void* user;
+  void (*upload)(void* user, const uint8_t* frame, int width, int height);
+  void (*present)(void* user);
+  int (*poll)(void* user);
+  uint8_t* (*lock_frame)(void* user);
+} NesmerizeFrontend;
+
+NESMERIZE_API void nesmerize_set_frontend(Nesmerize*, const NesmerizeFrontend*);
+
+// frames frames, or with a frontend until it's closed if that's 0
+NESMERIZE_API void nesmerize_run(Nesmerize*, uint32_t frames);
+
+// stops everything started below, writes what they write at the end (the
+// movie, the timing summary, the profile) and prints their counts
+NESMERIZE_API void nesmerize_finish(Nesmerize*);
+
+// scaling filters by name: "none", "scale2x" and so on. set_filter fails
+// for an unknown or null name, and filter_name is null past the last one
+NESMERIZE_API int nesmerize_set_filter(Nesmerize*, const char* name);
+NESMERIZE_API const char* nesmerize_filter(Nesmerize*);
+NESMERIZE_API const char* nesmerize_filter_name(int index);
+
+// frames to skip after each shown one, or one of these
+#define NESMERIZE_SKIP_AUTO -1 // as many as it takes to keep up
+#define NESMERIZE_SKIP_ALL -2 // nothing is shown
+NESMERIZE_API void nesmerize_set_frameskip(Nesmerize*, int frames);
+
+// the terminal debugger: a breakpoint at a hex address, or a break before
+// the next instruction
+NESMERIZE_API int nesmerize_add_breakpoint(Nesmerize*, const char* address);
+NESMERIZE_API void nesmerize_request_break(Nesmerize*);
+
+// input movies. a recording is saved to path by finish. resume_movie starts
+// playback from the latest cached state at or before last_frame, if there
+// is a state cache, and returns its frame
+NESMERIZE_API int nesmerize_open_state_cache(Nesmerize*, const char* directory);
+NESMERIZE_API int nesmerize_record_movie(Nesmerize*, const char* path);
+NESMERIZE_API int nesmerize_play_movie(Nesmerize*, const char* path);
+NESMERIZE_API int nesmerize_seek_movie(Nesmerize*, uint32_t frame);
+NESMERIZE_API uint32_t nesmerize_resume_movie(Nesmerize*, uint32_t last_frame);
+
+// rollback netplay over UDP on this machine's ports, player 1 or 2, with
+// simulated latency and packet loss (0 to 1) for testing
+NESMERIZE_API int nesmerize_start_netplay(Nesmerize*, int player, int local_port,
+                                          int remote_port, int latency_ms, double loss);
+
+// logs: the instruction trace, video and audio (either may be null), per
+// frame hashes, and frame timing, written to prefix.csv as it runs and
+// summarized in prefix.json every 600 frames and by finish
+NESMERIZE_API int nesmerize_start_trace(Nesmerize*, const char* path);
+NESMERIZE_API int nesmerize_record_video(Nesmerize*, const char* video, const char* audio);
+NESMERIZE_API int nesmerize_start_hash_log(Nesmerize*, const char* path);
+NESMERIZE_API int nesmerize_start_timing_log(Nesmerize*, const char* prefix);
+
+// the last frame's host time per stage, in ms, and the spread so far
+typedef struct NesmerizeTiming {
+  double emulation_ms;
+  double render_ms;
+  double upload_ms;
+  double present_ms;
+  double speed_ratio; // emulated time over host time
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+  uint64_t instructions;
+} NesmerizeTiming;
+
+NESMERIZE_API void nesmerize_frame_timing(Nesmerize*, NesmerizeTiming*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,616 @@
+// many machines running the same ROM, interpreted together
+//
+// for batch runs of one game (vecenv, rollouts from forks), where most
+// machines execute the same code at about the same time. the registers,
+// clocks and bus counters live here with one lane per machine. each step
+// takes the lanes at the lowest PC, decodes the instruction there once, and
+// runs it for all of them in loops over the lanes, which the compiler turns
+// into SSE, or AVX2/AVX-512 with -march=native. lanes elsewhere wait their
+// turn; since code mostly runs forward, lanes that took the longer side of
+// a branch catch up and the others rejoin them where the paths meet. RAM
+// stays in each machine, where the PPU, OAM DMA, save states and forks
+// expect it, and is reached through per-lane pointers.
+//
+// anything beyond registers and plain memory (I/O registers, interrupts,
+// BRK, RTI, PHP, PLP, indirect jumps, code in RAM) runs that lane alone
+// through CPU::execute_instruction(), with the same opcode table, so each
+// machine ends the frame in exactly the state run_frame() leaves it in.
+// a lane's PPU is only stepped when its clock reaches a new scanline, as
+// nothing else in step_to() has an effect before then. Memory's bus
+// counters, which are for timing stats and not part of the state, only
+// count the accesses that go through it.
+
+const int LOCKSTEP_LANES = 16;
+
+// then for lanes in the group and now for the others, without the branch
+// that would keep the loop from being vectorized
+template <typename T>
+inline T pick(uint8_t in_group, T then, T now) {
+  return now ^ ((now ^ then) & (T) -(T) in_group);
+}
+
+class Lockstep {
+  public:
+  // instructions run by lanes in a group, and by lanes alone
+  uint64_t grouped = 0;
+  uint64_t alone = 0;
+
+  void run_frame(NES**, int);
+
+  private:
+  NES* machines[LOCKSTEP_LANES];
+  int lanes = 0;
+  Opcode* opcodes;
+
+  // CPU registers, one lane per machine. the clock and instruction count
+  // are kept since the frame started, in 32 bits to fill more lanes of a
+  // vector
+  alignas(64) uint32_t clock[LOCKSTEP_LANES];
+  alignas(64) uint32_t instructions[LOCKSTEP_LANES];
+  alignas(64) uint16_t pc[LOCKSTEP_LANES];
+  alignas(32) uint16_t nz[LOCKSTEP_LANES];
+  alignas(32) uint16_t carry[LOCKSTEP_LANES];
+  alignas(16) uint8_t a[LOCKSTEP_LANES];
+  alignas(16) uint8_t x[LOCKSTEP_LANES];
+  alignas(16) uint8_t y[LOCKSTEP_LANES];
+  alignas(16) uint8_t sp[LOCKSTEP_LANES];
+  alignas(16) uint8_t overflow[LOCKSTEP_LANES];
+  alignas(16) uint8_t interrupt_disable[LOCKSTEP_LANES];
+  alignas(16) uint8_t decimal[LOCKSTEP_LANES];
+
+  // scheduling
+  alignas(64) uint32_t line_start[LOCKSTEP_LANES]; // clock the lane's next scanline starts at
+  alignas(64) uint32_t before[LOCKSTEP_LANES]; // clock before the current step
+  alignas(16) uint8_t active[LOCKSTEP_LANES]; // still in this frame
+  alignas(16) uint8_t pending[LOCKSTEP_LANES]; // an interrupt waits for the next instruction
+  alignas(16) uint8_t selected[LOCKSTEP_LANES]; // at the lowest PC
+  alignas(16) uint8_t group[LOCKSTEP_LANES]; // of those, the ones stepped together
+  int frame[LOCKSTEP_LANES]; // ppu.frames when the frame started
+  uint64_t start_clock[LOCKSTEP_LANES]; // and the clock and instruction count
+  uint64_t start_instructions[LOCKSTEP_LANES];
+  uint8_t* ram[LOCKSTEP_LANES];
+  uint8_t* prg_ram[LOCKSTEP_LANES];
+
+  // the current step's operands
+  uint8_t* prg_top; // the ROM, as Memory maps it
+  uint8_t* prg_bottom;
+  uint8_t* target[LOCKSTEP_LANES]; // the operand in memory
+  uint8_t discard; // stands in for it in lanes outside the group
+  alignas(32) uint16_t next_pc[LOCKSTEP_LANES];
+  alignas(16) uint8_t value[LOCKSTEP_LANES];
+  alignas(16) uint8_t extra[LOCKSTEP_LANES]; // cycles past the opcode's, for page crossings
+
+  bool eligible(NES&);
+  void load_lane(int);
+  void store_lane(int);
+  void update_lane(int);
+  void step_alone(int);
+  void step_group(uint16_t);
+  uint8_t* plain_memory(int, uint16_t, bool);
+  bool resolve(Opcode&, uint8_t, uint8_t, bool);
+  void finish_group(Opcode&, uint16_t);
+  void finish_lanes(Opcode&);
+};
+
+// what the group loop can't do for a machine at all: it runs its frame the
+// usual way instead
+bool Lockstep::eligible(NES& nes) {
+#ifdef PROFILER
+  return false;
+#endif
+  if (!nes.cpu.valid || nes.cpu.tracer || nes.debugger.active || nes.movie.mode != MOVIE_OFF) {
+    return false;
+  }
+  for (int page = 0; page < 0x100; ++page) {
+    if (nes.memory.page_traps[page] & TRAP_WATCH) {
+      return false;
+    }
+  }
+  // the lanes read the first one's copy of the program
+  return lanes == 0 || (nes.memory.prg_nrom_top == machines[0]->memory.prg_nrom_top &&
+                        nes.memory.prg_nrom_bottom == machines[0]->memory.prg_nrom_bottom);
+}
+
+void Lockstep::load_lane(int lane) {
+  NES& nes = *machines[lane];
+  CPU& cpu = nes.cpu;
+  clock[lane] = cpu.local_clock - start_clock[lane];
+  instructions[lane] = cpu.instructions - start_instructions[lane];
+  pc[lane] = cpu.PC;
+  nz[lane] = cpu.nz_result;
+  carry[lane] = cpu.carry_result;
+  a[lane] = cpu.accumulator;
+  x[lane] = cpu.X;
+  y[lane] = cpu.Y;
+  sp[lane] = cpu.SP;
+  overflow[lane] = cpu.overflow_result;
+  interrupt_disable[lane] = cpu.interrupt_disable;
+  decimal[lane] = cpu.decimal;
+}
+
+void Lockstep::store_lane(int lane) {
+  NES& nes = *machines[lane];
+  CPU& cpu = nes.cpu;
+  cpu.local_clock = start_clock[lane] + clock[lane];
+  cpu.instructions = start_instructions[lane] + instructions[lane];
+  cpu.PC = pc[lane];
+  cpu.nz_result = nz[lane];
+  cpu.carry_result = carry[lane];
+  cpu.accumulator = a[lane];
+  cpu.X = x[lane];
+  cpu.Y = y[lane];
+  cpu.SP = sp[lane];
+  cpu.overflow_result = overflow[lane];
+  cpu.interrupt_disable = interrupt_disable[lane];
+  cpu.decimal = decimal[lane];
+}
+
+// after the lane's PPU has been stepped
+void Lockstep::update_lane(int lane) {
+  NES& nes = *machines[lane];
+  uint64_t line_end = (nes.ppu.local_clock / 341 + 1) * 341; // in PPU cycles
+  line_start[lane] = (line_end + 2) / 3 - start_clock[lane];
+  pending[lane] = nes.cpu.interrupt_type != NONE;
+  active[lane] = nes.ppu.frames == frame[lane] && nes.cpu.valid;
+}
+
+// the same frame as NES::run_frame() for each machine. machines the lanes
+// can't take, and any past the lane count, run on their own
+void Lockstep::run_frame(NES** list, int count) {
+  lanes = 0;
+  memset(active, 0, sizeof(active));
+  memset(selected, 0, sizeof(selected));
+  memset(group, 0, sizeof(group));
+  for (int i = 0; i < count; ++i) {
+    NES& nes = *list[i];
+    if (lanes == LOCKSTEP_LANES || !eligible(nes)) {
+      nes.run_frame();
+      continue;
+    }
+    int lane = lanes++;
+    machines[lane] = &nes;
+    ram[lane] = nes.memory.internal_ram;
+    prg_ram[lane] = nes.memory.prg_ram;
+    frame[lane] = nes.ppu.frames;
+    start_clock[lane] = nes.cpu.local_clock;
+    start_instructions[lane] = nes.cpu.instructions;
+    load_lane(lane);
+    update_lane(lane);
+  }
+  if (lanes == 0) {
+    return;
+  }
+  opcodes = machines[0]->cpu.opcodes;
+  prg_top = machines[0]->memory.prg_nrom_top;
+  prg_bottom = machines[0]->memory.prg_nrom_bottom;
+
+  while (true) {
+    uint16_t lowest = 0xffff;
+    int running = 0;
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+      uint16_t candidate = pick<uint16_t>(active[lane], pc[lane], 0xffff);
+      lowest = candidate < lowest ? candidate : lowest;
+      running += active[lane];
+    }
+    if (running == 0) {
+      break;
+    }
+    int size = 0;
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+      selected[lane] = active[lane] & (pc[lane] == lowest);
+      group[lane] = selected[lane] & !pending[lane];
+      size += group[lane];
+    }
+    if (size > 1) {
+      step_group(lowest); // clears group for the lanes it leaves
+    } else {
+      memset(group, 0, sizeof(group));
+    }
+    for (int lane = 0; lane < lanes; ++lane) {
+      if (selected[lane] && !group[lane]) {
+        step_alone(lane);
+      }
+    }
+  }
+
+  for (int lane = 0; lane < lanes; ++lane) {
+    store_lane(lane);
+  }
+}
+
+// one instruction the usual way. the PPU is stepped to where it would be
+// first, the skipped steps having been within the same scanline
+void Lockstep::step_alone(int lane) {
+  NES& nes = *machines[lane];
+  store_lane(lane);
+  nes.ppu.step_to(nes.cpu.local_clock * 3);
+  nes.cpu.execute_instruction<false>();
+  nes.ppu.step_to(nes.cpu.local_clock * 3);
+  load_lane(lane);
+  update_lane(lane);
+  alone++;
+}
+
+// where in RAM, PRG RAM or (for reads) the ROM an address is, or null for
+// anything with side effects
+uint8_t* Lockstep::plain_memory(int lane, uint16_t address, bool writing) {
+  if (address < 0x2000) {
+    return ram[lane] + (address & 0x7ff);
+  } else if (address >= 0x6000 && address < 0x8000) {
+    return prg_ram[lane] + (address & 0x1fff);
+  } else if (address >= 0x8000 && !writing) {
+    return (address < 0xc000 ? prg_top : prg_bottom) + (address & 0x3fff);
+  }
+  return nullptr;
+}
+
+// each lane's operand, as CPU::get_memory_index() finds it. lanes whose
+// operand isn't plain memory leave the group, and false if none are left.
+// lanes outside the group get a byte nobody reads, so the loops after this
+// can load and store without checking
+bool Lockstep::resolve(Opcode& op, uint8_t arg1, uint8_t arg2, bool writing) {
+  uint16_t base = arg2 << 8 | arg1;
+  AddressingMode mode = op.addressing_mode;
+  if (mode == ZERO_PAGE || mode == ABSOLUTE) {
+    // the same address for every lane
+    uint16_t address = mode == ZERO_PAGE ? arg1 : base;
+    uint8_t* first = plain_memory(0, address, writing);
+    if (first == nullptr) {
+      return false;
+    }
+    // the same offset into each lane's RAM or PRG RAM
+    uint8_t** bases = address >= 0x6000 ? prg_ram : ram;
+    ptrdiff_t offset = first - bases[0];
+    bool rom = address >= 0x8000;
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+      target[lane] = !group[lane] ? &discard : rom ? first : bases[lane] + offset;
+    }
+    return true;
+  }
+  for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+    uint16_t address = 0;
+    switch (mode) {
+      case ZERO_PAGE_X:
+        address = (uint8_t) (arg1 + x[lane]);
+        break;
+      case ZERO_PAGE_Y:
+        address = (uint8_t) (arg1 + y[lane]);
+        break;
+      case ABSOLUTE_X:
+        address = base + x[lane];
+        extra[lane] = (uint8_t) (arg1 + x[lane]) < x[lane];
+        break;
+      case ABSOLUTE_Y:
+        address = base + y[lane];
+        extra[lane] = (uint8_t) (arg1 + y[lane]) < y[lane];
+        break;
+      case INDIRECT_X: {
+        if (!group[lane]) {
+          break;
+        }
+        uint8_t pointer = arg1 + x[lane];
+        address = ram[lane][(uint8_t) (pointer + 1)] << 8 | ram[lane][pointer];
+        break;
+      }
+      case INDIRECT_Y: {
+        if (!group[lane]) {
+          break;
+        }
+        uint8_t low = ram[lane][arg1];
+        address = (ram[lane][(uint8_t) (arg1 + 1)] << 8 | low) + y[lane];
+        extra[lane] = (uint8_t) (low + y[lane]) < y[lane];
+        break;
+      }
+      default:
+        return false;
+    }
+    target[lane] = group[lane] ? plain_memory(lane, address, writing) : nullptr;
+    group[lane] = target[lane] != nullptr;
+    target[lane] = group[lane] ? target[lane] : &discard;
+  }
+  for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+    if (group[lane]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// the instruction at pc for every lane in group, or for none of them if
+// it isn't one this loop does; they then run alone
+void Lockstep::step_group(uint16_t pc_now) {
+  if (pc_now < 0x8000 || pc_now > 0xfffd) {
+    memset(group, 0, sizeof(group));
+    return;
+  }
+  memset(extra, 0, sizeof(extra));
+  uint8_t* code = plain_memory(0, pc_now, false);
+  Opcode& op = opcodes[code[0]];
+  uint8_t arg1 = code[1];
+  uint8_t arg2 = code[2];
+  AddressingMode mode = op.addressing_mode;
+  bool memory = mode != IMPLIED && mode != IMMEDIATE && mode != ACCUMULATOR;
+  uint16_t next = pc_now + op.instruction_length;
+
+  switch (op.instruction) {
+    // loads and arithmetic
+    case LDA: case LDX: case LDY: case LAX: case ORA: case AND: case EOR:
+    case ADC: case SBC: case CMP: case CPX: case CPY: case BIT: case NOP:
+      if (mode == INDIRECT || mode == RELATIVE || mode == ACCUMULATOR ||
+          (memory && !resolve(op, arg1, arg2, false))) {
+        break;
+      }
+      if (memory) {
+        for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+          value[lane] = *target[lane];
+        }
+      } else {
+        memset(value, mode == IMMEDIATE ? arg1 : 0, sizeof(value));
+      }
+      switch (op.instruction) {
+        case LDA:
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            a[lane] = pick(group[lane], value[lane], a[lane]);
+            nz[lane] = pick<uint16_t>(group[lane], value[lane], nz[lane]);
+          }
+          break;
+        case LDX:
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            x[lane] = pick(group[lane], value[lane], x[lane]);
+            nz[lane] = pick<uint16_t>(group[lane], value[lane], nz[lane]);
+          }
+          break;
+        case LDY:
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            y[lane] = pick(group[lane], value[lane], y[lane]);
+            nz[lane] = pick<uint16_t>(group[lane], value[lane], nz[lane]);
+          }
+          break;
+        case LAX:
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            a[lane] = pick(group[lane], value[lane], a[lane]);
+            x[lane] = pick(group[lane], value[lane], x[lane]);
+            nz[lane] = pick<uint16_t>(group[lane], value[lane], nz[lane]);
+          }
+          break;
+        case ORA: case AND: case EOR:
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            uint8_t result = op.instruction == ORA ? a[lane] | value[lane] :
+              op.instruction == AND ? a[lane] & value[lane] : a[lane] ^ value[lane];
+            a[lane] = pick(group[lane], result, a[lane]);
+            nz[lane] = pick<uint16_t>(group[lane], result, nz[lane]);
+          }
+          break;
+        case ADC: case SBC:
+          // CPU::add_with_carry_helper(), SBC adding the complement
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            uint8_t operand = op.instruction == SBC ? ~value[lane] : value[lane];
+            uint8_t before = a[lane];
+            uint16_t sum = before + operand + ((carry[lane] >> 8) & 0x1);
+            a[lane] = pick<uint8_t>(group[lane], sum, before);
+            nz[lane] = pick<uint16_t>(group[lane], (uint8_t) sum, nz[lane]);
+            overflow[lane] = pick<uint8_t>(group[lane], ~(operand ^ before) & (before ^ sum),
+                                           overflow[lane]);
+            carry[lane] = pick(group[lane], sum, carry[lane]);
+          }
+          break;
+        case CMP: case CPX: case CPY:
+          // CPU::compare()
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            uint8_t reg = op.instruction == CMP ? a[lane] : op.instruction == CPX ? x[lane] : y[lane];
+            carry[lane] = pick<uint16_t>(group[lane], reg + (uint8_t) ~value[lane] + 1, carry[lane]);
+            nz[lane] = pick<uint16_t>(group[lane], (uint8_t) (reg - value[lane]), nz[lane]);
+          }
+          break;
+        case BIT:
+          for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            nz[lane] = pick<uint16_t>(group[lane],
+                                      (value[lane] & a[lane]) | ((value[lane] & 0x80) << 1), nz[lane]);
+            overflow[lane] = pick<uint8_t>(group[lane], value[lane] << 1, overflow[lane]);
+          }
+          break;
+        default:
+          break;
+      }
+      return finish_group(op, next);
+
+    // stores
+    case STA: case STX: case STY: case SAX:
+      if (!memory || mode == INDIRECT || !resolve(op, arg1, arg2, true)) {
+        break;
+      }
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        *target[lane] = op.instruction == STA ? a[lane] : op.instruction == STX ? x[lane] :
+          op.instruction == STY ? y[lane] : x[lane] & a[lane];
+      }
+      return finish_group(op, next);
+
+    // read-modify-write, on memory or the accumulator
+    case INC: case DEC: case ASL: case LSR: case ROL: case ROR:
+      if (mode == ACCUMULATOR) {
+        memcpy(value, a, sizeof(value));
+      } else if (!memory || mode == INDIRECT || !resolve(op, arg1, arg2, true)) {
+        break;
+      } else {
+        for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+          value[lane] = *target[lane];
+        }
+      }
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        uint8_t before = value[lane];
+        uint8_t carry_in = (carry[lane] >> 8) & 0x1;
+        uint8_t after = op.instruction == INC ? before + 1 : op.instruction == DEC ? before - 1 :
+          op.instruction == ASL ? before << 1 : op.instruction == LSR ? before >> 1 :
+          op.instruction == ROL ? before << 1 | carry_in : carry_in << 7 | before >> 1;
+        // shifts left carry out bit 7, shifts right bit 0
+        uint16_t carry_out = op.instruction == INC || op.instruction == DEC ? carry[lane] :
+          op.instruction == ASL || op.instruction == ROL ? before << 1 : (before & 0x1) << 8;
+        value[lane] = after;
+        nz[lane] = pick<uint16_t>(group[lane], after, nz[lane]);
+        carry[lane] = pick(group[lane], carry_out, carry[lane]);
+      }
+      if (mode == ACCUMULATOR) {
+        for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+          a[lane] = pick(group[lane], value[lane], a[lane]);
+        }
+        return finish_group(op, next);
+      }
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        *target[lane] = value[lane];
+      }
+      return finish_group(op, next);
+
+    // branches: the target is the same for every lane, taking it isn't
+    case BCC: case BCS: case BEQ: case BNE: case BMI: case BPL: case BVC: case BVS: {
+      uint16_t destination = next + (int8_t) arg1;
+      uint8_t crossed = (next >> 8) != (destination >> 8);
+      bool when_set = op.instruction == BCS || op.instruction == BEQ ||
+        op.instruction == BMI || op.instruction == BVS;
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        uint8_t flag = op.instruction == BCC || op.instruction == BCS ? (carry[lane] >> 8) & 0x1 :
+          op.instruction == BEQ || op.instruction == BNE ? (nz[lane] & 0xff) == 0 :
+          op.instruction == BMI || op.instruction == BPL ? (nz[lane] & 0x180) != 0 :
+          overflow[lane] >> 7;
+        uint8_t taken = flag == when_set;
+        next_pc[lane] = pick(taken, destination, next);
+        extra[lane] = taken * (1 + crossed);
+      }
+      return finish_lanes(op);
+    }
+
+    // flags and transfers
+    case CLC: case SEC: case CLV:
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        carry[lane] = pick<uint16_t>(group[lane] & (op.instruction != CLV),
+                                     op.instruction == SEC ? 0x100 : 0, carry[lane]);
+        overflow[lane] = pick<uint8_t>(group[lane] & (op.instruction == CLV), 0, overflow[lane]);
+      }
+      return finish_group(op, next);
+
+    case CLI: case SEI: case CLD: case SED:
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        uint8_t* flag = op.instruction == CLI || op.instruction == SEI ? interrupt_disable : decimal;
+        flag[lane] = pick<uint8_t>(group[lane], op.instruction == SEI || op.instruction == SED,
+                                   flag[lane]);
+      }
+      return finish_group(op, next);
+
+    case INX: case INY: case DEX: case DEY: case TAX: case TAY: case TXA: case TYA:
+    case TSX: case TXS:
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        uint8_t result;
+        switch (op.instruction) {
+          case INX: result = x[lane] + 1; break;
+          case INY: result = y[lane] + 1; break;
+          case DEX: result = x[lane] - 1; break;
+          case DEY: result = y[lane] - 1; break;
+          case TAX: case TAY: result = a[lane]; break;
+          case TXA: case TXS: result = x[lane]; break;
+          case TYA: result = y[lane]; break;
+          default: result = sp[lane]; break;
+        }
+        bool to_x = op.instruction == INX || op.instruction == DEX || op.instruction == TAX ||
+          op.instruction == TSX;
+        bool to_y = op.instruction == INY || op.instruction == DEY || op.instruction == TAY;
+        bool to_a = op.instruction == TXA || op.instruction == TYA;
+        bool to_sp = op.instruction == TXS; // the only one that leaves the flags
+        x[lane] = pick<uint8_t>(group[lane] & to_x, result, x[lane]);
+        y[lane] = pick<uint8_t>(group[lane] & to_y, result, y[lane]);
+        a[lane] = pick<uint8_t>(group[lane] & to_a, result, a[lane]);
+        sp[lane] = pick<uint8_t>(group[lane] & to_sp, result, sp[lane]);
+        nz[lane] = pick<uint16_t>(group[lane] & !to_sp, result, nz[lane]);
+      }
+      return finish_group(op, next);
+
+    // jumps and the stack, which is always RAM. pops read $0100 + SP + 1,
+    // $0200 for an empty stack, like CPU::stack_pop()
+    case JMP:
+      if (mode != ABSOLUTE) {
+        break;
+      }
+      return finish_group(op, arg2 << 8 | arg1);
+
+    case JSR:
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        if (group[lane]) {
+          ram[lane][0x100 + sp[lane]] = (pc_now + 2) >> 8;
+          ram[lane][0x100 + (uint8_t) (sp[lane] - 1)] = pc_now + 2;
+          sp[lane] -= 2;
+        }
+      }
+      return finish_group(op, arg2 << 8 | arg1);
+
+    case RTS:
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        if (group[lane]) {
+          uint8_t low = ram[lane][0x100 + sp[lane] + 1];
+          sp[lane]++;
+          uint8_t high = ram[lane][0x100 + sp[lane] + 1];
+          sp[lane]++;
+          next_pc[lane] = (high << 8 | low) + 1;
+        }
+      }
+      return finish_lanes(op);
+
+    case PHA:
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        if (group[lane]) {
+          ram[lane][0x100 + sp[lane]] = a[lane];
+          sp[lane]--;
+        }
+      }
+      return finish_group(op, next);
+
+    case PLA:
+      for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        if (group[lane]) {
+          a[lane] = ram[lane][0x100 + sp[lane] + 1];
+          nz[lane] = a[lane];
+          sp[lane]++;
+        }
+      }
+      return finish_group(op, next);
+
+    default:
+      break;
+  }
+  memset(group, 0, sizeof(group));
+}
+
+// moves the whole group on to next
+void Lockstep::finish_group(Opcode& op, uint16_t next) {
+  for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+    next_pc[lane] = next;
+  }
+  finish_lanes(op);
+}
+
+// moves each lane in the group on to its next_pc and counts its clock.
+// lanes that reached a new scanline have their PPU stepped,
+// first to where the last instruction left it, as the scalar loop would
+// have, then to now
+void Lockstep::finish_lanes(Opcode& op) {
+  bool crossed = false;
+  int size = 0;
+  for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+    uint32_t in_group = group[lane];
+    before[lane] = clock[lane];
+    pc[lane] = in_group ? next_pc[lane] : pc[lane];
+    clock[lane] += in_group * (op.cycles + extra[lane]);
+    instructions[lane] += in_group;
+    crossed |= in_group && clock[lane] >= line_start[lane];
+    size += in_group;
+  }
+  grouped += size;
+  if (!crossed) {
+    return;
+  }
+  for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+    if (group[lane] && clock[lane] >= line_start[lane]) {
+      PPU& ppu = machines[lane]->ppu;
+      ppu.step_to((start_clock[lane] + before[lane]) * 3);
+      ppu.step_to((start_clock[lane] + clock[lane]) * 3);
+      update_lane(lane);
+    }
+  }
+}
@@ -0,0 +1,105 @@
+// lockstep conformance harness
+//
+// runs a ROM on LOCKSTEP_LANES machines twice, once through
+// Lockstep::run_frame() and once one machine at a time through
+// NES::run_frame(), with the same pad per machine every frame. most lanes
+// share their input and some get their own random presses, so the lanes
+// split off from the groups and rejoin them. after every frame each pair's
+// save states have to be equal, and on drawn frames their screens too.
+// exits nonzero at the first mismatching frame.
+
+#include "nes.h"
+
+const int DEFAULT_FRAMES = 600;
+const int DIVERGENT_LANES = 4; // lanes with their own input, the rest share it
+const int DRAW_EVERY = 10; // frames, the rest run with rendering off
+
+// where two states first differ, -1 if they don't
+long first_difference(const vector<uint8_t>& a, const vector<uint8_t>& b) {
+  size_t size = min(a.size(), b.size());
+  for (size_t i = 0; i < size; ++i) {
+    if (a[i] != b[i]) {
+      return i;
+    }
+  }
+  return a.size() == b.size() ? -1 : size;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    cout << "Usage: lockstep_check.out game.nes [frames]\n";
+    return 1;
+  }
+  int frames = argc == 3 ? atoi(argv[2]) : DEFAULT_FRAMES;
+
+  NES boot;
+  boot.create_system();
+  if (!boot.load_program(argv[1])) {
+    return 1;
+  }
+  NES* scalar[LOCKSTEP_LANES];
+  NES* grouped[LOCKSTEP_LANES];
+  uint8_t input[LOCKSTEP_LANES][2] = {};
+  for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+    scalar[lane] = boot.fork();
+    grouped[lane] = boot.fork();
+    scalar[lane]->memory.frame_input = input[lane];
+    grouped[lane]->memory.frame_input = input[lane];
+  }
+
+  Lockstep lockstep;
+  uint32_t seed = 1;
+  double scalar_ns = 0;
+  double lockstep_ns = 0;
+  for (int frame = 0; frame < frames; ++frame) {
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+      seed = seed * 1103515245 + 12345;
+      input[lane][0] = lane < DIVERGENT_LANES ? seed >> 16 : (frame * 7) & 0xff;
+    }
+    bool draw = frame % DRAW_EVERY == DRAW_EVERY - 1;
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+      scalar[lane]->ppu.render_enabled = draw;
+      grouped[lane]->ppu.render_enabled = draw;
+    }
+
+    auto start = steady_clock::now();
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+      scalar[lane]->run_frame();
+    }
+    auto middle = steady_clock::now();
+    lockstep.run_frame(grouped, LOCKSTEP_LANES);
+    auto end = steady_clock::now();
+    scalar_ns += duration_cast<nanoseconds>(middle - start).count();
+    lockstep_ns += duration_cast<nanoseconds>(end - middle).count();
+
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+      SaveState expected, actual;
+      scalar[lane]->save_state(expected);
+      grouped[lane]->save_state(actual);
+      long difference = first_difference(expected.data, actual.data);
+      if (difference >= 0) {
+        printf("frame %d lane %d: states differ at byte %ld\n", frame, lane, difference);
+        return 1;
+      }
+      if (draw && memcmp(scalar[lane]->ppu.framebuffer, grouped[lane]->ppu.framebuffer, 256 * 240 * 4) != 0) {
+        printf("frame %d lane %d: screens differ\n", frame, lane);
+        return 1;
+      }
+    }
+  }
+
+  uint64_t instructions = lockstep.grouped + lockstep.alone;
+  printf("%d frames on %d lanes matched, %.1f%% of %lu instructions grouped; "
+         "scalar %.1f ms, lockstep %.1f ms\n",
+         frames,
+         LOCKSTEP_LANES,
+         100.0 * lockstep.grouped / max(instructions, (uint64_t) 1),
+         instructions,
+         scalar_ns / 1e6,
+         lockstep_ns / 1e6);
+  for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+    delete scalar[lane];
+    delete grouped[lane];
+  }
+  return 0;
+}
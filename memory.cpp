@@ -1,16 +1,42 @@
 #include <stdio.h>
 #include <stdint.h>
 
-class Memory {
+// page_traps bits. any set bit sends a write on that page down the slow
+// path, and any of READ_TRAPS a read, so the common case costs one table
+// lookup
+const uint8_t TRAP_IO = 0x1; // registers: $2000-$3FFF, $4000-$40FF
+const uint8_t TRAP_WATCH = 0x2; // a debugger watchpoint
+const uint8_t TRAP_ROM = 0x4; // PRG ROM, shared between machines: writes only
+const uint8_t READ_TRAPS = TRAP_IO | TRAP_WATCH;
+
+const int PRG_RAM_SIZE = 0x2000;
+
+// laid out for the bus fast path: the trap table, the PRG pointers and
+// the counters every access touches come first, then RAM and the registers,
+// so a read or write stays within a few lines of this object. the
+// connections and anything only used on the slow path go last, and PRG RAM
+// is kept by the NES after the PPU's state
+class alignas(64) Memory {
   public:
+    uint8_t page_traps[0x100];
+    uint8_t* prg_nrom_top;
+    uint8_t* prg_nrom_bottom;
+
+    // bus accesses this machine has made, for timing stats. not part of
+    // the machine state, so saving, loading or forking leaves them be
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+
     uint8_t internal_ram[0x800];
     uint8_t ppu_reg[0x8];
     uint8_t apu_io_registers[0x20];
-    uint8_t blank[0x3fe0];
-    uint8_t* prg_nrom_top;
-    uint8_t* prg_nrom_bottom;
+    uint8_t blank[1]; // all of $4020-$5FFF, nothing is mapped there
+
+    void initialize();
+    void transfer_state(SaveState&);
 
     uint8_t read(uint16_t);
+    uint8_t fetch(uint16_t);
     void write(uint16_t, uint8_t);
     void print_memory();
 
@@ -27,21 +53,57 @@ class Memory {
 
     // controller port
     void update_input();
-    uint8_t input_byte; // byte with input
+    uint8_t input_byte[2]; // shift registers read through $4016 and $4017
     bool input_strobe; // strobe indicates if input should be updated
+    uint8_t* frame_input = nullptr; // both pads, set per frame by netplay
 
     // hardware connections
     CPU* cpu;
     PPUMemory* ppumem;
     PPU* ppu;
-    GUI* gui;
+    Frontend* frontend = nullptr; // null when running headless
+    Movie* movie = nullptr; // overrides the frontend while recording or playing
+    Debugger* debugger = nullptr;
+    uint8_t* prg_ram = nullptr; // $6000-$7FFF, where test ROMs report results
+#ifdef PROFILER
+    Profiler* profiler;
+#endif
+
     void set_cpu(CPU*);
     void set_ppu_memory(PPUMemory*);
     void set_ppu(PPU*);
-    void set_gui(GUI*);
+    void set_frontend(Frontend*);
+
+  private:
+    uint8_t trapped_read(uint16_t, bool);
+    void trapped_write(uint16_t, uint8_t);
 };
 
 
+// power on with deterministic contents so recordings replay exactly
+void Memory::initialize() {
+  memset(internal_ram, 0, sizeof(internal_ram));
+  memset(ppu_reg, 0, sizeof(ppu_reg));
+  memset(apu_io_registers, 0, sizeof(apu_io_registers));
+  memset(blank, 0, sizeof(blank));
+  memset(prg_ram, 0, PRG_RAM_SIZE);
+  input_byte[0] = input_byte[1] = 0;
+  input_strobe = false;
+  for (int page = 0; page < 0x100; ++page) {
+    page_traps[page] = (page >= 0x20 && page < 0x41) ? TRAP_IO : page >= 0x80 ? TRAP_ROM : 0;
+  }
+}
+
+void Memory::transfer_state(SaveState& state) {
+  state.transfer(internal_ram);
+  state.transfer(ppu_reg);
+  state.transfer(apu_io_registers);
+  state.transfer(blank);
+  state.transfer_bytes(prg_ram, PRG_RAM_SIZE);
+  state.transfer(input_byte);
+  state.transfer(input_strobe);
+}
+
 void Memory::set_cpu(CPU* cpu_pointer) {
   cpu = cpu_pointer;
 }
@@ -54,8 +116,8 @@ void Memory::set_ppu(PPU* ppu_pointer) {
   ppu = ppu_pointer;
 }
 
-void Memory::set_gui(GUI* gui_pointer) {
-  gui = gui_pointer;
+void Memory::set_frontend(Frontend* frontend_pointer) {
+  frontend = frontend_pointer;
 }
 
 uint8_t* Memory::get_pointer(uint16_t ind) {
@@ -65,8 +127,10 @@ uint8_t* Memory::get_pointer(uint16_t ind) {
     return (ppu_reg + (ind & 0x7));
   } else if (ind < 0x4020) {
     return (apu_io_registers + (ind & 0x1f));
-  } else if (ind < 0x8000) {
+  } else if (ind < 0x6000) {
     return blank;
+  } else if (ind < 0x8000) {
+    return prg_ram + (ind & 0x1fff);
   } else if (ind < 0xc000) {
     return prg_nrom_top + (ind & 0x7fff);
   } else {
@@ -82,16 +146,42 @@ void Memory::set_prg_nrom_bottom(uint8_t* rom_pointer) {
   prg_nrom_bottom = rom_pointer;
 }
 
-// set checks here
 uint8_t Memory::read(uint16_t ind) {
+#ifdef PROFILER
+  profiler->mark_data(get_pointer(ind));
+#endif
+  reads++;
+  if (page_traps[ind >> 8] & READ_TRAPS) {
+    return trapped_read(ind, true);
+  }
+  return *get_pointer(ind);
+}
+
+// instruction stream reads, which the profiler counts as code rather than
+// data and watchpoints ignore
+uint8_t Memory::fetch(uint16_t ind) {
+  reads++;
+  if (page_traps[ind >> 8] & READ_TRAPS) {
+    return trapped_read(ind, false);
+  }
+  return *get_pointer(ind);
+}
+
+uint8_t Memory::trapped_read(uint16_t ind, bool data) {
+  if (data && (page_traps[ind >> 8] & TRAP_WATCH)) {
+    debugger->check_access(ind, 0, false);
+  }
   if (ind >= 0x2000 && ind < 0x4000) {
     return ppu->read_register(ind & 0x7);
-  } else if (ind == 0x4016) { // input from controller 1
-    uint8_t retval = 0x40 | (input_byte & 0x1); // some games expect 0x4 as the leading nibble
+  } else if (ind == 0x4016 || ind == 0x4017) { // input from controllers 1 and 2
+    // each port is a shift register, A first. it reloads continuously while
+    // the strobe is high, and shifts in 1s, so reads past the eighth give 1
+    uint8_t& port = input_byte[ind & 0x1];
+    uint8_t retval = 0x40 | (port & 0x1); // some games expect 0x4 as the leading nibble
     if (input_strobe) {
       update_input();
     } else {
-      input_byte >>= 1;
+      port = (port >> 1) | 0x80;
     }
     return retval;
   }
@@ -99,12 +189,46 @@ uint8_t Memory::read(uint16_t ind) {
 }
 
 void Memory::update_input() {
-  input_byte = gui->get_input();
+  if (frame_input) {
+    input_byte[0] = frame_input[0];
+    input_byte[1] = frame_input[1];
+  } else if (movie && movie->mode != MOVIE_OFF) {
+    input_byte[0] = movie->input;
+    input_byte[1] = 0;
+  } else if (frontend) {
+    input_byte[0] = frontend->get_input(0);
+    input_byte[1] = frontend->get_input(1);
+  } else {
+    input_byte[0] = input_byte[1] = 0;
+  }
 }
 
 void Memory::write(uint16_t ind, uint8_t val) {
+  writes++;
+  if (page_traps[ind >> 8]) {
+    trapped_write(ind, val);
+    return;
+  }
+  *(get_pointer(ind)) = val;
+}
+
+void Memory::trapped_write(uint16_t ind, uint8_t val) {
+  if (page_traps[ind >> 8] & TRAP_WATCH) {
+    debugger->check_access(ind, val, true);
+  }
   if (ind == 0x4014) {
-    ppumem->dma_write_oam(get_pointer(val * 0x100));
+    uint16_t page = val * 0x100;
+    if (val >= 0x20 && val < 0x60) {
+      // registers and unmapped space aren't 256 bytes of memory, so those
+      // pages are read through the bus, as the DMA unit does
+      uint8_t bytes[0x100];
+      for (int i = 0; i < 0x100; ++i) {
+        bytes[i] = read(page + i);
+      }
+      ppumem->dma_write_oam(bytes);
+    } else {
+      ppumem->dma_write_oam(get_pointer(page));
+    }
     cpu->local_clock += 513;
   } else if (ind >= 0x2000 && ind < 0x4000) {
     ppu->write_register(ind & 0x7, val);
@@ -115,6 +239,8 @@ void Memory::write(uint16_t ind, uint8_t val) {
       update_input();
     }
     return;
+  } else if (page_traps[ind >> 8] & TRAP_ROM) {
+    return; // NROM ignores them, and other machines run this copy
   }
   *(get_pointer(ind)) = val;
 }
@@ -0,0 +1,227 @@
+// input movies
+//
+// a movie is one controller byte per frame from power on, plus machine
+// snapshots (keyframes) every KEYFRAME_INTERVAL frames. keyframes are added
+// whenever emulation reaches an interval frame without one, so imported fm2
+// movies gain them as they play. seeking restores the nearest keyframe at or
+// before the target and runs the rest headless; see NES::seek_movie().
+//
+// .nmv layout, little endian:
+//   MovieHeader
+//   uint8_t inputs[frame_count]
+//   keyframe_count x { uint32_t frame; uint32_t size; uint8_t state[size]; }
+
+const char MOVIE_MAGIC[4] = {'N', 'M', 'O', 'V'};
+const uint16_t MOVIE_VERSION = 2;
+const uint32_t KEYFRAME_INTERVAL = 300; // 5 seconds
+
+// fm2 gamepad columns, which happen to be our input bits from 7 down to 0
+const char FM2_BUTTONS[] = "RLDUTSBA";
+
+enum MovieMode {MOVIE_OFF, MOVIE_RECORD, MOVIE_PLAYBACK};
+
+struct MovieHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t keyframe_interval;
+  uint64_t rom_hash;
+  uint32_t frame_count;
+  uint32_t keyframe_count;
+};
+
+struct Keyframe {
+  uint32_t frame;
+  vector<uint8_t> state;
+};
+
+class Movie {
+  public:
+  MovieMode mode = MOVIE_OFF;
+  uint64_t rom_hash = 0;
+  vector<uint8_t> inputs;
+  vector<Keyframe> keyframes; // sorted by frame
+  uint32_t frame = 0; // frame being emulated, counted from power on
+  uint8_t input = 0; // controller byte for that frame
+
+  void clear();
+  bool save(const char*);
+  bool load(const char*);
+  bool export_fm2(const char*, const char*);
+  bool import_fm2(const char*);
+
+  bool has_keyframe(uint32_t);
+  void add_keyframe(uint32_t, vector<uint8_t>&);
+  Keyframe* nearest_keyframe(uint32_t);
+  void truncate(uint32_t);
+};
+
+bool has_extension(const char* filename, const char* extension) {
+  size_t length = strlen(filename);
+  size_t extension_length = strlen(extension);
+  return length >= extension_length &&
+    strcmp(filename + length - extension_length, extension) == 0;
+}
+
+void Movie::clear() {
+  inputs.clear();
+  keyframes.clear();
+  frame = 0;
+  input = 0;
+}
+
+bool Movie::has_keyframe(uint32_t keyframe) {
+  for (Keyframe& key : keyframes) {
+    if (key.frame == keyframe) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// keyframes arrive in order except after a seek, so keep them sorted
+void Movie::add_keyframe(uint32_t keyframe, vector<uint8_t>& state) {
+  Keyframe key;
+  key.frame = keyframe;
+  key.state = state;
+  auto position = keyframes.end();
+  while (position != keyframes.begin() && (position - 1)->frame > keyframe) {
+    position--;
+  }
+  keyframes.insert(position, key);
+}
+
+// there is always a keyframe at frame 0
+Keyframe* Movie::nearest_keyframe(uint32_t target) {
+  Keyframe* best = &keyframes[0];
+  for (Keyframe& key : keyframes) {
+    if (key.frame > target) {
+      break;
+    }
+    best = &key;
+  }
+  return best;
+}
+
+// drops everything from `target` on, for re-recording after a seek
+void Movie::truncate(uint32_t target) {
+  if (inputs.size() > target) {
+    inputs.resize(target);
+  }
+  while (!keyframes.empty() && keyframes.back().frame > target) {
+    keyframes.pop_back();
+  }
+}
+
+bool Movie::save(const char* filename) {
+  if (has_extension(filename, ".fm2")) {
+    return export_fm2(filename, "");
+  }
+  FILE* out = fopen(filename, "wb");
+  if (out == nullptr) {
+    return false;
+  }
+  MovieHeader header;
+  memcpy(header.magic, MOVIE_MAGIC, 4);
+  header.version = MOVIE_VERSION;
+  header.keyframe_interval = KEYFRAME_INTERVAL;
+  header.rom_hash = rom_hash;
+  header.frame_count = inputs.size();
+  header.keyframe_count = keyframes.size();
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(inputs.data(), 1, inputs.size(), out);
+  for (Keyframe& key : keyframes) {
+    uint32_t size = key.state.size();
+    fwrite(&key.frame, sizeof(key.frame), 1, out);
+    fwrite(&size, sizeof(size), 1, out);
+    fwrite(key.state.data(), 1, size, out);
+  }
+  fclose(out);
+  return true;
+}
+
+bool Movie::load(const char* filename) {
+  if (has_extension(filename, ".fm2")) {
+    return import_fm2(filename);
+  }
+  FILE* in = fopen(filename, "rb");
+  if (in == nullptr) {
+    return false;
+  }
+  MovieHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, MOVIE_MAGIC, 4) != 0 ||
+      header.version != MOVIE_VERSION) {
+    fclose(in);
+    return false;
+  }
+  clear();
+  rom_hash = header.rom_hash;
+  inputs.resize(header.frame_count);
+  bool ok = fread(inputs.data(), 1, inputs.size(), in) == inputs.size();
+  for (uint32_t i = 0; ok && i < header.keyframe_count; ++i) {
+    Keyframe key;
+    uint32_t size;
+    ok = fread(&key.frame, sizeof(key.frame), 1, in) == 1 &&
+      fread(&size, sizeof(size), 1, in) == 1;
+    if (ok) {
+      key.state.resize(size);
+      ok = fread(key.state.data(), 1, size, in) == size;
+      keyframes.push_back(key);
+    }
+  }
+  fclose(in);
+  return ok;
+}
+
+// fceux text format, one gamepad on port 0. the rom checksum is an md5 we
+// don't compute, so it's left out
+bool Movie::export_fm2(const char* filename, const char* rom_name) {
+  FILE* out = fopen(filename, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  fprintf(out, "version 3\nemuVersion 0\nrerecordCount 0\npalFlag 0\n");
+  fprintf(out, "romFilename %s\nguid 00000000-0000-0000-0000-000000000000\n", rom_name);
+  fprintf(out, "fourscore 0\nmicrophone 0\nport0 1\nport1 0\nport2 0\nFDS 0\nNewPPU 0\n");
+  for (uint8_t value : inputs) {
+    char buttons[9];
+    for (int i = 0; i < 8; ++i) {
+      buttons[i] = (value >> (7 - i)) & 0x1 ? FM2_BUTTONS[i] : '.';
+    }
+    buttons[8] = 0;
+    fprintf(out, "|0|%s|||\n", buttons);
+  }
+  fclose(out);
+  return true;
+}
+
+bool Movie::import_fm2(const char* filename) {
+  FILE* in = fopen(filename, "r");
+  if (in == nullptr) {
+    return false;
+  }
+  clear();
+  char line[256];
+  while (fgets(line, sizeof(line), in)) {
+    if (line[0] != '|') {
+      continue; // header key/value lines
+    }
+    // |commands|port0|port1|port2|
+    char* port0 = strchr(line + 1, '|');
+    if (port0 == nullptr) {
+      continue;
+    }
+    if (atoi(line + 1) != 0) {
+      cout << "fm2 reset/command on frame " << inputs.size() << " ignored\n";
+    }
+    uint8_t value = 0;
+    for (int i = 0; i < 8 && port0[i + 1] && port0[i + 1] != '|'; ++i) {
+      if (port0[i + 1] != '.' && port0[i + 1] != ' ') {
+        value |= 1 << (7 - i);
+      }
+    }
+    inputs.push_back(value);
+  }
+  fclose(in);
+  return true;
+}
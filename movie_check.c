@@ -0,0 +1,133 @@
+/* movie recording check for libnesmerize
+ *
+ * records a movie headless through the C API, holding pads set with
+ * nesmerize_set_input() that change every few frames, and checks that the
+ * movie has those pads in it, that a run setting the same pads without a
+ * movie ends in the same state, and that playing the movie back does too.
+ * plain C on purpose, so it only sees what libnesmerize.h offers.
+ * exits nonzero on the first thing that's wrong. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libnesmerize.h"
+
+#define DEFAULT_FRAMES 300
+#define MOVIE_PATH "movie_check.fm2"
+
+/* the pad held on frame, a new one every 4 frames */
+static uint8_t pad_for_frame(uint32_t frame) {
+  uint32_t seed = (frame / 4 + 1) * 2654435761u;
+  return (uint8_t) (seed >> 24);
+}
+
+static Nesmerize* open_rom(const char* path) {
+  Nesmerize* instance = nesmerize_create();
+  if (!nesmerize_load_file(instance, path)) {
+    printf("could not load %s\n", path);
+    exit(1);
+  }
+  return instance;
+}
+
+static uint8_t* save(Nesmerize* instance, size_t size) {
+  uint8_t* state = malloc(size);
+  nesmerize_save_state(instance, state, size);
+  return state;
+}
+
+/* the buttons on each |0|RLDUTSBA||| line, in movie order */
+static int read_movie(const char* path, uint8_t* pads, int max) {
+  FILE* in = fopen(path, "r");
+  if (in == NULL) {
+    return -1;
+  }
+  const char* names = "RLDUTSBA";
+  char line[256];
+  int count = 0;
+  while (count < max && fgets(line, sizeof(line), in)) {
+    if (strncmp(line, "|0|", 3) != 0 || strlen(line) < 11) {
+      continue;
+    }
+    uint8_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      if (line[3 + i] == names[i]) {
+        value |= 0x80 >> i;
+      }
+    }
+    pads[count++] = value;
+  }
+  fclose(in);
+  return count;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || argc > 3) {
+    printf("Usage: movie_check.out game.nes [frames]\n");
+    return 1;
+  }
+  uint32_t frames = argc == 3 ? (uint32_t) atoi(argv[2]) : DEFAULT_FRAMES;
+
+  /* frame n's pad is picked as frame n - 1 ends, so it's set a frame early */
+  Nesmerize* recorded = open_rom(argv[1]);
+  nesmerize_set_input(recorded, 0, pad_for_frame(0));
+  nesmerize_record_movie(recorded, MOVIE_PATH);
+  for (uint32_t frame = 0; frame < frames; ++frame) {
+    nesmerize_set_input(recorded, 0, pad_for_frame(frame + 1));
+    nesmerize_run(recorded, 1);
+  }
+  nesmerize_finish(recorded);
+
+  Nesmerize* live = open_rom(argv[1]);
+  for (uint32_t frame = 0; frame < frames; ++frame) {
+    nesmerize_set_input(live, 0, pad_for_frame(frame));
+    nesmerize_run(live, 1);
+  }
+
+  Nesmerize* played = open_rom(argv[1]);
+  if (!nesmerize_play_movie(played, MOVIE_PATH)) {
+    printf("could not play back %s\n", MOVIE_PATH);
+    return 1;
+  }
+  nesmerize_run(played, frames);
+
+  int failed = 0;
+  uint8_t* pads = malloc(frames + 1);
+  int count = read_movie(MOVIE_PATH, pads, frames + 1);
+  if (count != (int) frames + 1) {
+    printf("movie has %d frames, expected %u\n", count, frames + 1);
+    failed = 1;
+  }
+  for (int frame = 0; frame < count && !failed; ++frame) {
+    if (pads[frame] != pad_for_frame(frame)) {
+      printf("movie frame %d has pad %02x, it was %02x\n", frame, pads[frame], pad_for_frame(frame));
+      failed = 1;
+    }
+  }
+
+  size_t size = nesmerize_state_size(recorded);
+  uint8_t* recorded_state = save(recorded, size);
+  uint8_t* live_state = save(live, size);
+  uint8_t* played_state = save(played, size);
+  if (!failed && memcmp(recorded_state, live_state, size) != 0) {
+    printf("recording state differs from running the same pads live\n");
+    failed = 1;
+  }
+  if (!failed && memcmp(recorded_state, played_state, size) != 0) {
+    printf("playback state differs from the recording\n");
+    failed = 1;
+  }
+  if (!failed) {
+    printf("%u frames recorded, played back and matched\n", frames);
+  }
+
+  free(pads);
+  free(recorded_state);
+  free(live_state);
+  free(played_state);
+  nesmerize_destroy(recorded);
+  nesmerize_destroy(live);
+  nesmerize_destroy(played);
+  remove(MOVIE_PATH);
+  return failed;
+}
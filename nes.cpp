@@ -1,113 +1,144 @@
-#include <stdio.h>
-#include <stdint.h>
-#include <iostream>
-#include <fstream>
-#include <chrono>
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
-
-using namespace std;
-
-enum Interrupt {NONE, IRQ, NMI};
-
-#include "opcodes.cpp"
-#include "palette.cpp"
-#include "cpu.h"
-#include "memory.h"
+// the emulator program: a client of the C interface in libnesmerize.h,
+// with the SDL window from gui.cpp
 
+#include "libnesmerize.cpp"
 #include "gui.cpp"
-#include "ppu_memory.cpp"
-#include "ppu.h"
-#include "ppu.cpp"
-#include "memory.cpp"
-#include "cpu.cpp"
 
-using namespace std::chrono;
-
-class NES {
-  public:
-  CPU cpu;
-  Memory memory;
-  PPU ppu;
-  PPUMemory ppu_memory;
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    cout << "Specify a filename\n";
+    return 1;
+  }
+  char* trace_filename = nullptr;
+  char* timing_prefix = nullptr;
+  char* record_filename = nullptr;
+  char* play_filename = nullptr;
+  int seek_frame = 0;
+  char* netplay_spec = nullptr;
+  char* video_filename = nullptr;
+  char* audio_filename = nullptr;
+  char* hash_filename = nullptr;
+  char* filter_name = nullptr;
+  char* frameskip_spec = nullptr;
+  char* break_spec = nullptr;
+  char* cache_directory = nullptr;
+  int headless_frames = 0;
+  int netplay_latency = 0;
+  double netplay_loss = 0;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--trace") == 0) {
+      trace_filename = argv[i + 1];
+    } else if (strcmp(argv[i], "--timing-log") == 0) {
+      timing_prefix = argv[i + 1];
+    } else if (strcmp(argv[i], "--record") == 0) {
+      record_filename = argv[i + 1];
+    } else if (strcmp(argv[i], "--play") == 0) {
+      play_filename = argv[i + 1];
+    } else if (strcmp(argv[i], "--seek") == 0) {
+      seek_frame = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--record-video") == 0) {
+      video_filename = argv[i + 1];
+    } else if (strcmp(argv[i], "--record-audio") == 0) {
+      audio_filename = argv[i + 1];
+    } else if (strcmp(argv[i], "--filter") == 0) {
+      filter_name = argv[i + 1];
+    } else if (strcmp(argv[i], "--break") == 0) {
+      break_spec = argv[i + 1];
+    } else if (strcmp(argv[i], "--frameskip") == 0) {
+      frameskip_spec = argv[i + 1];
+    } else if (strcmp(argv[i], "--state-cache") == 0) {
+      cache_directory = argv[i + 1];
+    } else if (strcmp(argv[i], "--hash-log") == 0) {
+      hash_filename = argv[i + 1];
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      headless_frames = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--netplay") == 0) {
+      netplay_spec = argv[i + 1];
+    } else if (strcmp(argv[i], "--netplay-latency") == 0) {
+      netplay_latency = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--netplay-loss") == 0) {
+      netplay_loss = atof(argv[i + 1]) / 100;
+    }
+  }
+  Nesmerize* emulator = nesmerize_create();
+  if (cache_directory && !nesmerize_open_state_cache(emulator, cache_directory)) {
+    cout << "could not open state cache " << cache_directory << "\n";
+    return 1;
+  }
   GUI gui;
-
-  void create_system();
-  void load_program(char*);
-  void play_game(char*);
-  void run_game();
-
-  // debugging
-  void print_pattern_tables();
-};
-
-
-void NES::create_system() {
-  cpu.set_memory(&memory);
-  cpu.set_ppu(&ppu);
-  ppu.set_memory(&memory);
-  ppu.set_ppu_memory(&ppu_memory);
-  ppu.set_cpu(&cpu);
-  ppu.set_gui(&gui);
-  memory.set_cpu(&cpu);
-  memory.set_ppu_memory(&ppu_memory);
-  memory.set_ppu(&ppu);
-  memory.set_gui(&gui);
-  ppu.initialize();
-  gui.initialize();
-}
-
-void NES::load_program(char* filename) {
-  ifstream rom(filename, ios::binary | ios::ate);
-  streamsize size = rom.tellg();
-  rom.seekg(0, ios::beg);
-  char *buffer = new char[size];
-
-  if (rom.read(buffer, size)) {
-    int prg_size = buffer[4] * 0x4000;
-    int mapper = (buffer[6] >> 4) | (buffer[7] & 0xf0);
-    if (mapper != 0) {
-      cout << "not mapper 0! exiting...";
-      return;
+  if (!headless_frames) {
+    gui.initialize(emulator);
+    NesmerizeFrontend frontend = gui.callbacks();
+    nesmerize_set_frontend(emulator, &frontend);
+  }
+  if (!nesmerize_load_file(emulator, argv[1])) {
+    return 1;
+  }
+  if (filter_name && !nesmerize_set_filter(emulator, filter_name)) {
+    cout << "unknown filter " << filter_name << "\n";
+    return 1;
+  }
+  if (play_filename) {
+    if (!nesmerize_play_movie(emulator, play_filename)) {
+      return 1;
+    }
+    if (seek_frame) {
+      nesmerize_seek_movie(emulator, seek_frame);
+    } else if (cache_directory) {
+      // the run still ends headless_frames after power on
+      uint32_t resumed = nesmerize_resume_movie(emulator,
+                                                headless_frames ? headless_frames - 1 : UINT32_MAX);
+      headless_frames -= headless_frames ? resumed : 0;
     }
-    // set PRG memory pointers
-    char* program = (buffer + 0x10);
-    memory.set_prg_nrom_top((uint8_t*) program);
-    if (prg_size == 0x4000) {
-      memory.set_prg_nrom_bottom((uint8_t*) program);
-    } else {
-      memory.set_prg_nrom_bottom((uint8_t*) program + 0x4000);
+  } else if (record_filename) {
+    nesmerize_record_movie(emulator, record_filename);
+  }
+  if (netplay_spec) {
+    // player:local_port:remote_port, player 1 or 2
+    int player, local_port, remote_port;
+    if (sscanf(netplay_spec, "%d:%d:%d", &player, &local_port, &remote_port) != 3 ||
+        player < 1 || player > 2) {
+      cout << "--netplay takes player:local_port:remote_port\n";
+      return 1;
     }
-    // set PPU CHR memory pointers
-    int chr_size = buffer[5] * 8192;
-    uint8_t* chr_data = (uint8_t*) program + prg_size;
-    if (chr_size > 0) {
-      ppu_memory.set_pattern_tables(chr_data);
+    if (!nesmerize_start_netplay(emulator, player, local_port, remote_port, netplay_latency,
+                                 netplay_loss)) {
+      return 1;
     }
-    cpu.initialize();
   }
-}
-
-// alternative is to run CPU until PPU latch is
-// 'filled' and then step PPU to that point
-void NES::run_game() {
-  while(cpu.valid && gui.valid) {
-    cpu.execute_instruction();
-    ppu.step_to(cpu.local_clock * 3); // PPU clock is 3x
+  if (trace_filename) {
+    nesmerize_start_trace(emulator, trace_filename);
   }
-}
-
-void NES::play_game(char* filename) {
-  create_system();
-  load_program(filename);
-  run_game();
-}
-
-int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    cout << "Specify a filename\n";
+  if (break_spec) {
+    // start, or an address to break at
+    if (strcmp(break_spec, "start") == 0) {
+      nesmerize_request_break(emulator);
+    } else if (!nesmerize_add_breakpoint(emulator, break_spec)) {
+      cout << "--break takes start or a hex address\n";
+      return 1;
+    }
+  }
+  if ((video_filename || audio_filename) &&
+      !nesmerize_record_video(emulator, video_filename, audio_filename)) {
+    cout << "could not open " << (video_filename ? video_filename : "") << " "
+         << (audio_filename ? audio_filename : "") << "\n";
+    return 1;
+  }
+  if (hash_filename && !nesmerize_start_hash_log(emulator, hash_filename)) {
     return 1;
   }
-  NES nes;
-  nes.play_game(argv[1]);
+  if (frameskip_spec) {
+    // a number of frames to skip after each shown one, or auto
+    bool automatic = strcmp(frameskip_spec, "auto") == 0;
+    nesmerize_set_frameskip(emulator, automatic ? NESMERIZE_SKIP_AUTO : atoi(frameskip_spec));
+  } else if (headless_frames) {
+    nesmerize_set_frameskip(emulator, NESMERIZE_SKIP_ALL); // nobody looks at the frames
+  }
+  if (timing_prefix) {
+    // per-frame rows as it runs, percentiles at exit
+    nesmerize_start_timing_log(emulator, timing_prefix);
+  }
+  nesmerize_run(emulator, headless_frames);
+  nesmerize_finish(emulator);
+  nesmerize_destroy(emulator);
 }
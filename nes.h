@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+using namespace std;
+using namespace std::chrono;
+
+enum Interrupt {NONE, IRQ, NMI};
+
+#include "opcodes.cpp"
+#include "palette.cpp"
+#include "disassembler.cpp"
+#include "trace.cpp"
+#include "timing.cpp"
+#include "savestate.cpp"
+#include "movie.cpp"
+#include "workers.cpp"
+#include "ntsc.cpp"
+#include "scaler.cpp"
+#include "netplay.cpp"
+#include "recorder.cpp"
+#include "hashlog.cpp"
+#include "statecache.cpp"
+#include "cpu.h"
+#include "memory.h"
+#include "debugger.h"
+#include "frontend.h"
+#ifdef PROFILER
+#include "profiler.h"
+#endif
+
+#include "ppu_memory.cpp"
+#include "ppu.h"
+#include "ppu.cpp"
+#include "memory.cpp"
+#include "cpu.cpp"
+#include "debugger.cpp"
+#ifdef PROFILER
+#include "profiler.cpp"
+#endif
+
+
+class NES {
+  public:
+  // the hot state, in this order: cpu registers, the bus (trap table, RAM,
+  // register files), PPU registers and clocks. each starts on a cache line
+  // and they follow each other with nothing cold in between; CHR RAM ends
+  // ppu_memory, and everything after it, PRG RAM included, is off the fast
+  // path. the ROM, CHR ROM, opcode table and palettes are shared. the frame
+  // buffers, CHR RAM and the tooling (netplay, video recording, filters,
+  // execute breakpoints, the frame time histogram) are allocated when first
+  // used, so a machine that only runs frames takes about 16KB
+  CPU cpu;
+  Memory memory;
+  PPU ppu;
+  PPUMemory ppu_memory;
+  uint8_t prg_ram[PRG_RAM_SIZE]; // memory's, only read and written by a few games
+  Frontend* frontend = nullptr; // window and keyboard, if any
+  Tracer tracer;
+  FrameTimer timing;
+  FrameSkip frame_skip;
+  Debugger debugger;
+  Movie movie;
+  StateCache* state_cache = nullptr; // keeps movie keyframes across runs, if set
+  Netplay* netplay = nullptr; // allocated by start_netplay()
+  Recorder* recorder = nullptr; // allocated by the first recording
+  Scaler* scaler = nullptr; // allocated by the first filter
+  HashLog hash_log;
+  SaveState hash_state; // reused every frame while hashing
+  uint64_t hashed_instructions = 0;
+  SaveState fork_fields; // fork_into()'s listing, until the next ROM
+  shared_ptr<vector<uint8_t>> rom; // the iNES image, shared by forks
+  uint64_t rom_hash;
+#ifdef PROFILER
+  Profiler profiler;
+  void write_profile(const char*);
+#endif
+
+  ~NES();
+  void create_system();
+  void set_frontend(Frontend*);
+  bool load_program(const char*);
+  bool load_rom(const uint8_t*, size_t);
+  void share_rom(NES&);
+  void map_rom();
+  void run_game(uint32_t frame_limit = 0);
+  void run_frame();
+  void run_cycles(uint64_t);
+  void reset();
+  template <bool debugging>
+  void run_instructions();
+
+  // snapshots of everything but the framebuffer
+  void save_state(SaveState&);
+  void load_state(SaveState&);
+  void transfer_state(SaveState&);
+
+  // copies of the running machine for search and rollout: the same state,
+  // sharing the ROM. movies, netplay and the rest of the tooling stay behind
+  NES* fork(bool with_frame = false);
+  void fork_into(NES&, bool with_frame = false);
+
+  // movies start from power on, so these go right after load_program()
+  void start_recording();
+  bool start_playback(const char*);
+  bool seek_movie(uint32_t);
+  uint32_t resume_movie(uint32_t);
+  void begin_movie_frame();
+  uint8_t live_input();
+
+  // both players start from power on, so this also goes right after load_program()
+  bool start_netplay(int, int, int);
+  void run_netplay_frame(uint8_t);
+
+  // hash log of every shown frame, for comparing runs
+  bool start_hash_log(const char*);
+  void write_frame_hashes(uint32_t);
+
+  // tracing can be switched on and off between any two instructions
+  bool start_tracing(const char*);
+  void stop_tracing();
+
+  // debugging
+  void print_pattern_tables();
+};
+
+
+// FNV-1a, to tell ROMs apart
+uint64_t hash_bytes(uint8_t* data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+NES::~NES() {
+  delete netplay;
+  delete recorder;
+  delete scaler;
+}
+
+// starts headless, see set_frontend()
+void NES::create_system() {
+  cpu.set_memory(&memory);
+  cpu.set_ppu(&ppu);
+  ppu.set_memory(&memory);
+  ppu.set_ppu_memory(&ppu_memory);
+  ppu.set_cpu(&cpu);
+  memory.set_cpu(&cpu);
+  memory.set_ppu_memory(&ppu_memory);
+  memory.set_ppu(&ppu);
+  memory.prg_ram = prg_ram;
+  memory.initialize();
+  ppu_memory.initialize();
+  ppu.initialize();
+  timing.initialize();
+  memory.movie = &movie;
+  debugger.set_cpu(&cpu);
+  debugger.set_memory(&memory);
+  debugger.initialize();
+  cpu.debugger = &debugger;
+  memory.debugger = &debugger;
+  ppu.timing = &timing;
+#ifdef PROFILER
+  profiler.initialize(&memory);
+  cpu.profiler = &profiler;
+  memory.profiler = &profiler;
+#endif
+}
+
+// shows frames and reads pad 1 from it, null for headless
+void NES::set_frontend(Frontend* frontend_ptr) {
+  frontend = frontend_ptr;
+  ppu.set_frontend(frontend);
+  memory.set_frontend(frontend);
+}
+
+bool NES::load_program(const char* filename) {
+  ifstream rom(filename, ios::binary | ios::ate);
+  streamsize size = rom.tellg();
+  rom.seekg(0, ios::beg);
+  vector<uint8_t> buffer(max(size, (streamsize) 0));
+
+  if (size > 0 && rom.read((char*) buffer.data(), size)) {
+    return load_rom(buffer.data(), size);
+  }
+  cout << "could not read " << filename << "\n";
+  return false;
+}
+
+// an iNES image. the data is copied, so the caller can free it
+bool NES::load_rom(const uint8_t* data, size_t size) {
+  if (size < 0x10 || memcmp(data, "NES\x1a", 4) != 0) {
+    cout << "not an iNES file\n";
+    return false;
+  }
+  int prg_size = data[4] * 0x4000;
+  int chr_size = data[5] * 8192;
+  int mapper = (data[6] >> 4) | (data[7] & 0xf0);
+  if (mapper != 0) {
+    cout << "not mapper 0! exiting...";
+    return false;
+  }
+  if (prg_size == 0 || size < 0x10 + (size_t) (prg_size + chr_size)) {
+    cout << "ROM is truncated\n";
+    return false;
+  }
+  rom = make_shared<vector<uint8_t>>(data, data + size);
+  rom_hash = hash_bytes(rom->data(), size);
+  map_rom();
+  return true;
+}
+
+// the same game as other, without another copy of it
+void NES::share_rom(NES& other) {
+  rom = other.rom;
+  rom_hash = other.rom_hash;
+  map_rom();
+}
+
+// points the buses at rom, and powers on
+void NES::map_rom() {
+  uint8_t* data = rom->data();
+  int prg_size = data[4] * 0x4000;
+  int chr_size = data[5] * 8192;
+  fork_fields.fields.clear(); // CHR RAM is state, CHR ROM isn't
+
+  // set PRG memory pointers
+  uint8_t* program = data + 0x10;
+  memory.set_prg_nrom_top(program);
+  if (prg_size == 0x4000) {
+    memory.set_prg_nrom_bottom(program);
+  } else {
+    memory.set_prg_nrom_bottom(program + 0x4000);
+  }
+#ifdef PROFILER
+  profiler.set_prg(program, prg_size);
+#endif
+  // set PPU CHR memory pointers
+  uint8_t* chr_data = program + prg_size;
+  if (chr_size > 0) {
+    ppu_memory.set_pattern_tables(chr_data);
+  } else {
+    ppu_memory.use_chr_ram();
+  }
+  cpu.initialize();
+}
+
+// alternative is to run CPU until PPU latch is
+// 'filled' and then step PPU to that point
+// without a frontend it runs frame_limit frames, otherwise until the window
+// closes or the limit (if any) is reached
+void NES::run_game(uint32_t frame_limit) {
+  ppu.allocate_frame(); // read by the frontend, recorder, hash log and scaler
+  if (scaler) {
+    scaler->indices = ppu.pixels;
+  }
+  for (uint32_t frame = 0; cpu.valid && (!frontend || frontend->valid); ++frame) {
+    if (frame_limit && frame == frame_limit) {
+      break;
+    }
+    // recordings and hash logs need every frame drawn
+    bool recording = recorder && recorder->active;
+    ppu.render_enabled = recording || hash_log.file || frame_skip.render_next();
+    // straight into the window, unless something reads ppu.framebuffer after
+    uint8_t* direct = nullptr;
+    if (frontend && ppu.render_enabled && !recording && !hash_log.file) {
+      direct = frontend->lock_frame();
+    }
+    ppu.output = direct ? direct : ppu.framebuffer;
+    if (netplay && netplay->active) {
+      run_netplay_frame(live_input());
+    } else {
+      run_frame();
+    }
+    if (recording) {
+      recorder->end_frame(ppu.framebuffer);
+    }
+    if (hash_log.file) {
+      write_frame_hashes(frame);
+    }
+    timing.end_frame(cpu.instructions, memory.reads, memory.writes);
+  }
+}
+
+// runs until the PPU has finished (and shown) a frame
+void NES::run_frame() {
+  if (debugger.active) {
+    run_instructions<true>();
+  } else {
+    run_instructions<false>();
+  }
+  if (movie.mode != MOVIE_OFF) {
+    movie.frame++;
+    begin_movie_frame();
+  }
+}
+
+template <bool debugging>
+void NES::run_instructions() {
+  int frame = ppu.frames;
+  while (ppu.frames == frame && cpu.valid) {
+    cpu.execute_instruction<debugging>();
+    ppu.step_to(cpu.local_clock * 3); // PPU clock is 3x
+  }
+}
+
+// at least cycles cpu cycles, finishing the last instruction. for embedders
+// that sync to something other than frames; movies only advance in run_frame()
+void NES::run_cycles(uint64_t cycles) {
+  uint64_t target = cpu.local_clock + cycles;
+  while (cpu.local_clock < target && cpu.valid) {
+    cpu.execute_instruction();
+    ppu.step_to(cpu.local_clock * 3);
+  }
+}
+
+// the console's reset button. the PPU ignores $2000 and $2001 writes for a
+// while after reset, which comes to the same thing as clearing them
+void NES::reset() {
+  cpu.reset();
+  ppu.reg2000.value = 0;
+  ppu.reg2001.value = 0;
+  ppu.palette_dirty = true;
+}
+
+void NES::save_state(SaveState& state) {
+  state.begin_save();
+  transfer_state(state);
+}
+
+void NES::load_state(SaveState& state) {
+  state.begin_load();
+  transfer_state(state);
+}
+
+void NES::transfer_state(SaveState& state) {
+  cpu.transfer_state(state);
+  memory.transfer_state(state);
+  ppu.transfer_state(state);
+  ppu_memory.transfer_state(state);
+}
+
+// a new machine in this one's state, running the same copy of the ROM.
+// delete it when done
+NES* NES::fork(bool with_frame) {
+  NES* child = new NES;
+  child->create_system();
+  child->share_rom(*this);
+  fork_into(*child, with_frame);
+  return child;
+}
+
+// overwrites child, which has to have the same ROM loaded, with this
+// machine's state: a save and load without the buffer in between, about
+// 15KB of memcpy, nearly all of it RAM. the fields are listed through
+// transfer_state() and sit at the same offsets in both machines, apart from
+// CHR RAM, which each machine allocates for itself. reusing children this
+// way skips fork()'s allocation. the last frame is only copied when asked
+// for
+void NES::fork_into(NES& child, bool with_frame) {
+  if (fork_fields.fields.empty()) {
+    fork_fields.begin_listing();
+    transfer_state(fork_fields);
+    // the offset copy below only reaches the child for fields inside this
+    // object, so anything else has to be copied by name, as CHR RAM is
+    uint8_t* start = (uint8_t*) this;
+    uint8_t* end = (uint8_t*) (this + 1);
+    for (pair<uint8_t*, size_t>& field : fork_fields.fields) {
+      assert((field.first == ppu_memory.chr_ram_data && field.second == CHR_RAM_SIZE) ||
+             (field.first >= start && field.first + field.second <= end));
+    }
+  }
+  child.ppu_memory.chr_ram = ppu_memory.chr_ram;
+  ptrdiff_t offset = (uint8_t*) &child - (uint8_t*) this;
+  for (pair<uint8_t*, size_t>& field : fork_fields.fields) {
+    if (field.first == ppu_memory.chr_ram_data) {
+      memcpy(child.ppu_memory.chr_ram_data, field.first, field.second);
+    } else {
+      memcpy(field.first + offset, field.first, field.second);
+    }
+  }
+  child.ppu.palette_dirty = true;
+  // pixels has every drawn frame, but framebuffer misses those drawn into
+  // a window or a caller's buffer, so the colors come from pixels
+  if (with_frame && ppu.pixels) {
+    child.ppu.allocate_frame();
+    memcpy(child.ppu.pixels, ppu.pixels, 256 * 240 * sizeof(uint16_t));
+    uint32_t* colors = (uint32_t*) child.ppu.framebuffer;
+    for (int i = 0; i < 256 * 240; ++i) {
+      colors[i] = PALETTE_ARGB.colors[ppu.pixels[i]];
+    }
+  }
+}
+
+void NES::start_recording() {
+  movie.clear();
+  movie.rom_hash = rom_hash;
+  movie.mode = MOVIE_RECORD;
+  begin_movie_frame();
+}
+
+bool NES::start_playback(const char* filename) {
+  if (!movie.load(filename)) {
+    cout << "could not read movie " << filename << "\n";
+    return false;
+  }
+  if (movie.rom_hash && movie.rom_hash != rom_hash) {
+    cout << "movie was recorded with a different ROM\n";
+    return false;
+  }
+  movie.rom_hash = rom_hash;
+  movie.frame = 0;
+  movie.mode = MOVIE_PLAYBACK;
+  // keyframes from a build with a different state layout can't be loaded,
+  // but playback recreates them
+  SaveState current;
+  save_state(current);
+  for (size_t i = movie.keyframes.size(); i-- > 0;) {
+    if (movie.keyframes[i].state.size() != current.data.size()) {
+      movie.keyframes.erase(movie.keyframes.begin() + i);
+    }
+  }
+  if (movie.keyframes.empty() || movie.keyframes[0].frame != 0) {
+    begin_movie_frame();
+  } else {
+    // start from the recorded power on state
+    seek_movie(0);
+  }
+  return true;
+}
+
+// snapshots interval frames and picks the controller byte for this frame.
+// recording replays what it already has (after a seek) before taking live input
+void NES::begin_movie_frame() {
+  if (movie.frame % KEYFRAME_INTERVAL == 0 && !movie.has_keyframe(movie.frame)) {
+    SaveState state;
+    save_state(state);
+    movie.add_keyframe(movie.frame, state.data);
+    // pad 2 isn't in movies, and is only left alone outside netplay
+    if (state_cache && movie.frame > 0 && !(netplay && netplay->active)) {
+      uint64_t prefix_hash = xxhash64(movie.inputs.data(), movie.frame);
+      state_cache->store(rom_hash, prefix_hash, movie.frame, state);
+    }
+  }
+  if (movie.frame < movie.inputs.size()) {
+    movie.input = movie.inputs[movie.frame];
+  } else if (movie.mode == MOVIE_RECORD) {
+    movie.input = live_input();
+    movie.inputs.push_back(movie.input);
+  } else {
+    movie.mode = MOVIE_OFF; // end of playback, back to live input
+    cout << "movie ended at frame " << movie.frame << "\n";
+  }
+}
+
+// pad 1 as the player is holding it: the window's keys, or what a library
+// client set with nesmerize_set_input(). memory.frontend is null while frames
+// are being re-run, and the pads read 0 once the window is closed
+uint8_t NES::live_input() {
+  Frontend* pads = memory.frontend;
+  return pads && (!frontend || frontend->valid) ? pads->get_input(0) : 0;
+}
+
+// restores the nearest keyframe and runs headless up to the target
+bool NES::seek_movie(uint32_t target) {
+  if (movie.mode == MOVIE_OFF || target > movie.inputs.size()) {
+    return false;
+  }
+  if (movie.mode == MOVIE_RECORD) {
+    movie.truncate(target); // re-record from the target on
+  }
+  Keyframe* key = movie.nearest_keyframe(target);
+  SaveState state;
+  state.data = key->state;
+  load_state(state);
+  movie.frame = key->frame;
+  Frontend* shown = ppu.frontend;
+  Frontend* pads = memory.frontend;
+  bool render = ppu.render_enabled;
+  ppu.frontend = nullptr;
+  memory.frontend = nullptr;
+  begin_movie_frame();
+  while (movie.frame < target && cpu.valid) {
+    // draw only the frame the seek lands on
+    ppu.render_enabled = movie.frame + 1 == target;
+    run_frame();
+  }
+  ppu.frontend = shown;
+  memory.frontend = pads;
+  ppu.render_enabled = render;
+  return true;
+}
+
+// jumps playback to the latest cached keyframe at or before limit that this
+// movie's inputs lead to, instead of emulating up to it. returns its frame,
+// 0 if there's none and playback still starts at power on
+uint32_t NES::resume_movie(uint32_t limit) {
+  if (state_cache == nullptr || movie.mode != MOVIE_PLAYBACK || movie.frame != 0) {
+    return 0;
+  }
+  uint32_t last = min<uint32_t>(limit, movie.inputs.size());
+  size_t state_size = movie.keyframes[0].state.size(); // power on, from start_playback()
+  for (uint32_t frame = last - last % KEYFRAME_INTERVAL; frame > 0; frame -= KEYFRAME_INTERVAL) {
+    if (movie.has_keyframe(frame)) {
+      return seek_movie(frame) ? frame : 0; // the movie file had it already
+    }
+    SaveState state;
+    uint64_t prefix_hash = xxhash64(movie.inputs.data(), frame);
+    if (state_cache->load(rom_hash, prefix_hash, frame, state) && state.data.size() == state_size) {
+      movie.add_keyframe(frame, state.data);
+      return seek_movie(frame) ? frame : 0;
+    }
+  }
+  return 0;
+}
+
+bool NES::start_netplay(int player, int local_port, int remote_port) {
+  if (netplay == nullptr) {
+    netplay = new Netplay;
+  }
+  if (!netplay->initialize(player, local_port, remote_port)) {
+    cout << "could not open netplay port " << local_port << "\n";
+    return false;
+  }
+  return true;
+}
+
+// sends this frame's input, rolls back and re-runs any frames that used a
+// wrong guess for the remote pad, then runs this frame on the newest guess
+void NES::run_netplay_frame(uint8_t input) {
+  netplay->add_local_input(input);
+  netplay->exchange();
+  auto stall_start = steady_clock::now();
+  while (netplay->too_far_ahead()) {
+    if (steady_clock::now() - stall_start > milliseconds(NETPLAY_TIMEOUT_MS)) {
+      cout << "netplay peer stopped responding at frame " << netplay->frame << "\n";
+      netplay->close();
+      memory.frame_input = nullptr;
+      run_frame();
+      return;
+    }
+    this_thread::sleep_for(milliseconds(1)); // let the remote catch up
+    netplay->exchange();
+  }
+
+  const int slots = MAX_ROLLBACK + 1;
+  uint32_t first = netplay->rollback_frame;
+  if (first < netplay->frame) {
+    netplay->rollbacks++;
+    load_state(netplay->snapshots[first % slots]);
+    Frontend* shown = ppu.frontend;
+    Frontend* pads = memory.frontend;
+    bool render = ppu.render_enabled;
+    ppu.frontend = nullptr;
+    memory.frontend = nullptr;
+    ppu.render_enabled = false; // only the last frame is seen
+    for (uint32_t f = first; f < netplay->frame; ++f) {
+      if (f > first) {
+        save_state(netplay->snapshots[f % slots]);
+      }
+      memory.frame_input = netplay->inputs_for_frame(f);
+      run_frame();
+      netplay->resimulated_frames++;
+    }
+    ppu.frontend = shown;
+    memory.frontend = pads;
+    ppu.render_enabled = render;
+  }
+
+  save_state(netplay->snapshots[netplay->frame % slots]);
+  memory.frame_input = netplay->inputs_for_frame(netplay->frame);
+  run_frame();
+  netplay->end_frame();
+}
+
+bool NES::start_hash_log(const char* filename) {
+  if (!hash_log.open(filename, rom_hash)) {
+    cout << "could not open hash log " << filename << "\n";
+    return false;
+  }
+  hashed_instructions = cpu.instructions;
+  return true;
+}
+
+void NES::write_frame_hashes(uint32_t frame) {
+  save_state(hash_state);
+  HashRecord record;
+  record.frame = frame;
+  record.instructions = cpu.instructions - hashed_instructions;
+  record.framebuffer = xxhash64(ppu.framebuffer, 256 * 240 * 4);
+  record.state = xxhash64(hash_state.data.data(), hash_state.data.size());
+  hash_log.write(record);
+  hashed_instructions = cpu.instructions;
+}
+
+bool NES::start_tracing(const char* filename) {
+  if (tracer.records == nullptr) {
+    tracer.initialize(16); // flush every 1 MB of records
+  }
+  if (!tracer.open_file(filename)) {
+    cout << "could not open trace file " << filename << "\n";
+    return false;
+  }
+  cpu.set_tracer(&tracer);
+  return true;
+}
+
+void NES::stop_tracing() {
+  cpu.set_tracer(nullptr);
+  tracer.close();
+}
+
+#ifdef PROFILER
+// writes <prefix>.profile.txt and <prefix>.cdl
+void NES::write_profile(const char* prefix) {
+  string name(prefix);
+  OpcodeGenerator gen;
+  profiler.write_report((name + ".profile.txt").c_str(), gen.generate_all_opcodes());
+  profiler.write_coverage((name + ".cdl").c_str());
+  cout << "wrote " << name << ".profile.txt and " << name << ".cdl\n";
+}
+#endif
+
+#include "lockstep.cpp"
@@ -0,0 +1,146 @@
+// nestest conformance harness
+//
+// runs nestest.nes headless from its automated entry point at $C000 and
+// checks every instruction against a nintendulator reference log as it goes,
+// stopping at the first mismatch. both log layouts are understood:
+//   C000  4C F5 C5  JMP $C5F5     A:00 X:00 Y:00 P:24 SP:FD CYC:  0 SL:241
+//   C000  4C F5 C5  JMP $C5F5     A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+// the first one compares ppu dot and scanline, the second total cpu cycles.
+
+#include "nes.h"
+
+const int CONTEXT_LINES = 8; // must be a power of two, see Tracer
+const uint64_t NESTEST_START_CYCLES = 7; // reset sequence in the newer log
+
+struct ExpectedState {
+  uint16_t pc;
+  uint8_t accumulator;
+  uint8_t x;
+  uint8_t y;
+  uint8_t flags;
+  uint8_t sp;
+  bool has_scanline; // false means cpu_cycles is filled in instead
+  int cycle;
+  int scanline;
+  uint64_t cpu_cycles;
+};
+
+bool read_hex(const char* line, const char* key, unsigned* value) {
+  const char* found = strstr(line, key);
+  return found && sscanf(found + strlen(key), "%x", value) == 1;
+}
+
+bool parse_log_line(const char* line, ExpectedState& state) {
+  unsigned pc, a, x, y, p, sp;
+  if (sscanf(line, "%4x", &pc) != 1 ||
+      !read_hex(line + 48, "A:", &a) ||
+      !read_hex(line + 48, "X:", &x) ||
+      !read_hex(line + 48, "Y:", &y) ||
+      !read_hex(line + 48, "P:", &p) ||
+      !read_hex(line + 48, "SP:", &sp)) {
+    return false;
+  }
+  state.pc = pc;
+  state.accumulator = a;
+  state.x = x;
+  state.y = y;
+  state.flags = p;
+  state.sp = sp;
+  const char* sl = strstr(line, "SL:");
+  const char* cyc = strstr(line, "CYC:");
+  if (cyc == nullptr) {
+    return false;
+  }
+  state.has_scanline = sl != nullptr;
+  if (state.has_scanline) {
+    state.cycle = atoi(cyc + 4);
+    state.scanline = atoi(sl + 3);
+    if (state.scanline == -1) {
+      state.scanline = 261;
+    }
+  } else {
+    state.cpu_cycles = strtoull(cyc + 4, nullptr, 10);
+  }
+  return true;
+}
+
+bool matches(TraceRecord& record, uint64_t cpu_cycles, ExpectedState& state) {
+  if (record.pc != state.pc || record.accumulator != state.accumulator ||
+      record.x != state.x || record.y != state.y ||
+      record.flags != state.flags || record.sp != state.sp) {
+    return false;
+  }
+  if (state.has_scanline) {
+    return record.cycle == state.cycle && record.scanline == state.scanline;
+  }
+  return cpu_cycles + NESTEST_START_CYCLES == state.cpu_cycles;
+}
+
+void print_context(Opcode* opcodes, Tracer& tracer, char reference[][128], uint64_t line_number) {
+  char line[128];
+  uint64_t first = line_number >= CONTEXT_LINES ? line_number - CONTEXT_LINES + 1 : 0;
+  printf("expected:\n");
+  for (uint64_t i = first; i <= line_number; ++i) {
+    printf("  %5lu %s", i + 1, reference[i & (CONTEXT_LINES - 1)]);
+  }
+  printf("got:\n");
+  for (uint64_t i = first; i <= line_number; ++i) {
+    format_trace_record(line, opcodes, tracer.records[i & tracer.mask]);
+    printf("  %5lu %s", i + 1, line);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    cout << "Usage: nestest.out nestest.nes nestest.log\n";
+    return 1;
+  }
+  FILE* log = fopen(argv[2], "r");
+  if (log == nullptr) {
+    cout << "could not open " << argv[2] << "\n";
+    return 1;
+  }
+
+  NES nes;
+  nes.create_system();
+  nes.load_program(argv[1]);
+  nes.cpu.set_program_counter(0xc000);
+  // the tracer captures state before each instruction, and its ring doubles
+  // as the context shown on a mismatch
+  nes.tracer.initialize(3);
+  nes.cpu.set_tracer(&nes.tracer);
+
+  OpcodeGenerator gen;
+  Opcode* opcodes = gen.generate_all_opcodes();
+  char reference[CONTEXT_LINES][128];
+  uint64_t line_number = 0;
+  auto start = high_resolution_clock::now();
+
+  while (fgets(reference[line_number & (CONTEXT_LINES - 1)], 128, log)) {
+    char* text = reference[line_number & (CONTEXT_LINES - 1)];
+    ExpectedState expected;
+    if (!parse_log_line(text, expected)) {
+      printf("could not parse line %lu of %s: %s", line_number + 1, argv[2], text);
+      return 1;
+    }
+    uint64_t cpu_cycles = nes.cpu.local_clock;
+    nes.cpu.execute_instruction();
+    nes.ppu.step_to(nes.cpu.local_clock * 3);
+    TraceRecord& record = nes.tracer.records[line_number & nes.tracer.mask];
+    if (!matches(record, cpu_cycles, expected)) {
+      printf("mismatch at line %lu\n", line_number + 1);
+      print_context(opcodes, nes.tracer, reference, line_number);
+      return 1;
+    }
+    line_number++;
+  }
+
+  auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start);
+  // nestest leaves its official / unofficial opcode error codes in $02 and $03
+  printf("%lu instructions matched in %ld us, result codes %02X %02X\n",
+         line_number,
+         (long) elapsed.count(),
+         nes.memory.internal_ram[2],
+         nes.memory.internal_ram[3]);
+  return 0;
+}
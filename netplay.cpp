@@ -0,0 +1,219 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <deque>
+#include <random>
+
+// two player rollback netplay over UDP
+//
+// every frame each side sends its recent inputs and runs ahead with a
+// guess for the remote pad (the last one it heard). when the real input
+// for an already emulated frame arrives and differs from the guess, the
+// NES rolls back to that frame's snapshot and re-runs headless up to the
+// present; see NES::run_netplay_frame(). this class is the transport and
+// input bookkeeping. outgoing packets can be delayed and dropped on purpose
+// to stand in for a real network when both players are on one machine.
+
+const char NETPLAY_MAGIC[4] = {'N', 'P', 'L', 'Y'};
+const int MAX_ROLLBACK = 16; // frames we may run ahead of the remote player
+const int NETPLAY_REDUNDANCY = 32; // inputs repeated per packet against loss
+const int NETPLAY_TIMEOUT_MS = 5000; // stall this long and the peer is gone
+
+struct NetplayPacket {
+  char magic[4];
+  uint32_t frame; // last input in the packet
+  uint32_t ack; // the sender has every input below this
+  uint8_t count;
+  uint8_t inputs[NETPLAY_REDUNDANCY]; // frames frame - count + 1 .. frame
+};
+
+struct DelayedPacket {
+  uint64_t send_at_ms;
+  NetplayPacket packet;
+};
+
+class Netplay {
+  public:
+  bool active = false;
+  int player; // 0 is controller 1, 1 is controller 2
+  uint32_t frame = 0; // next frame to emulate
+  uint32_t rollback_frame; // earliest mispredicted frame, or frame if none
+  uint64_t rollbacks = 0;
+  uint64_t resimulated_frames = 0;
+  SaveState snapshots[MAX_ROLLBACK + 1]; // the machine, indexed by frame
+
+  // simulated network conditions for local testing
+  int latency_ms = 0;
+  double loss = 0;
+
+  bool initialize(int, int, int);
+  void close();
+  void add_local_input(uint8_t);
+  uint8_t* inputs_for_frame(uint32_t);
+  void exchange();
+  bool too_far_ahead();
+  void end_frame();
+
+  private:
+  int socket_fd = -1;
+  sockaddr_in remote;
+  vector<uint8_t> local_inputs;
+  vector<uint8_t> remote_inputs;
+  vector<bool> remote_known;
+  vector<uint8_t> predicted; // the guess each emulated frame actually used
+  uint32_t remote_confirmed = 0; // every remote input below this is known
+  uint32_t remote_acked = 0; // the remote has our inputs below this
+  uint8_t frame_inputs[2];
+  deque<DelayedPacket> outgoing;
+  mt19937 random;
+
+  void send_inputs();
+  void flush_outgoing();
+  void receive_inputs();
+  void store_remote_input(uint32_t, uint8_t);
+  uint64_t now_ms();
+};
+
+uint64_t Netplay::now_ms() {
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool Netplay::initialize(int local_player, int local_port, int remote_port) {
+  player = local_player;
+  socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket_fd < 0) {
+    return false;
+  }
+  sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(local_port);
+  local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(socket_fd, (sockaddr*) &local, sizeof(local)) < 0) {
+    ::close(socket_fd);
+    return false;
+  }
+  fcntl(socket_fd, F_SETFL, O_NONBLOCK);
+  memset(&remote, 0, sizeof(remote));
+  remote.sin_family = AF_INET;
+  remote.sin_port = htons(remote_port);
+  remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  random.seed(local_port);
+  frame = 0;
+  rollback_frame = 0;
+  active = true;
+  return true;
+}
+
+void Netplay::close() {
+  if (socket_fd >= 0) {
+    ::close(socket_fd);
+    socket_fd = -1;
+  }
+  active = false;
+}
+
+void Netplay::add_local_input(uint8_t input) {
+  local_inputs.push_back(input);
+}
+
+// both pads for a frame, guessing the remote one if it hasn't arrived yet
+uint8_t* Netplay::inputs_for_frame(uint32_t target) {
+  if (predicted.size() <= target) {
+    predicted.resize(target + 1);
+  }
+  uint8_t remote_input;
+  if (target < remote_known.size() && remote_known[target]) {
+    remote_input = remote_inputs[target];
+  } else {
+    remote_input = remote_confirmed > 0 ? remote_inputs[remote_confirmed - 1] : 0;
+  }
+  predicted[target] = remote_input;
+  frame_inputs[player] = local_inputs[target];
+  frame_inputs[1 - player] = remote_input;
+  return frame_inputs;
+}
+
+bool Netplay::too_far_ahead() {
+  return frame >= remote_confirmed + MAX_ROLLBACK;
+}
+
+void Netplay::end_frame() {
+  frame++;
+  rollback_frame = frame;
+}
+
+void Netplay::exchange() {
+  send_inputs();
+  flush_outgoing();
+  receive_inputs();
+}
+
+// the oldest inputs the remote hasn't acknowledged, so none are skipped
+void Netplay::send_inputs() {
+  NetplayPacket packet;
+  memcpy(packet.magic, NETPLAY_MAGIC, 4);
+  uint32_t oldest = min<uint32_t>(remote_acked, local_inputs.size() - 1);
+  uint32_t newest = min<uint32_t>(oldest + NETPLAY_REDUNDANCY, local_inputs.size()) - 1;
+  packet.frame = newest;
+  packet.ack = remote_confirmed;
+  packet.count = newest - oldest + 1;
+  for (uint32_t f = oldest; f <= newest; ++f) {
+    packet.inputs[f - oldest] = local_inputs[f];
+  }
+  uniform_real_distribution<double> chance(0, 1);
+  if (loss > 0 && chance(random) < loss) {
+    return;
+  }
+  outgoing.push_back({now_ms() + latency_ms, packet});
+}
+
+void Netplay::flush_outgoing() {
+  uint64_t now = now_ms();
+  while (!outgoing.empty() && outgoing.front().send_at_ms <= now) {
+    sendto(socket_fd, &outgoing.front().packet, sizeof(NetplayPacket), 0,
+           (sockaddr*) &remote, sizeof(remote));
+    outgoing.pop_front();
+  }
+}
+
+void Netplay::receive_inputs() {
+  NetplayPacket packet;
+  while (recv(socket_fd, &packet, sizeof(packet), 0) == sizeof(packet)) {
+    if (memcmp(packet.magic, NETPLAY_MAGIC, 4) != 0 || packet.count > NETPLAY_REDUNDANCY) {
+      continue;
+    }
+    // the peer stalls MAX_ROLLBACK frames past what it has of ours, so
+    // anything much further on, or starting before frame 0, isn't a packet
+    // it sent, and would wrap the frame numbers or size the input vectors
+    if (packet.count > packet.frame + 1 || packet.frame > frame + 2 * MAX_ROLLBACK) {
+      continue;
+    }
+    remote_acked = max(remote_acked, packet.ack);
+    uint32_t oldest = packet.frame + 1 - packet.count;
+    for (int i = 0; i < packet.count; ++i) {
+      store_remote_input(oldest + i, packet.inputs[i]);
+    }
+  }
+}
+
+void Netplay::store_remote_input(uint32_t target, uint8_t input) {
+  if (remote_known.size() <= target) {
+    remote_known.resize(target + 1, false);
+    remote_inputs.resize(target + 1, 0);
+  }
+  if (remote_known[target]) {
+    return;
+  }
+  remote_known[target] = true;
+  remote_inputs[target] = input;
+  while (remote_confirmed < remote_known.size() && remote_known[remote_confirmed]) {
+    remote_confirmed++;
+  }
+  // an emulated frame ran with the wrong guess
+  if (target < frame && predicted[target] != input) {
+    rollback_frame = min(rollback_frame, target);
+  }
+}
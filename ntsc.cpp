@@ -0,0 +1,166 @@
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// NTSC composite video filter
+//
+// instead of looking colors up in PALETTE this rebuilds the signal the PPU
+// puts on the wire from the palette indices and emphasis bits in
+// ppu.pixels, then decodes it the way a TV would, so colors bleed into
+// their neighbours and dithered patterns turn into artifact colors.
+//
+// the signal model is the one on the nesdev wiki ("NTSC video"): every
+// pixel is 8 samples of a square wave between two voltage levels, with a
+// color subcarrier period of 12 samples, and each emphasis bit attenuates a
+// third of the wave. the decoder averages 12 samples around each output
+// pixel and demodulates them to YIQ. the output is 512 wide, 4 samples per
+// output pixel, so every output pixel sees one whole source pixel and half
+// of one neighbour.
+//
+// all of that is linear, so it collapses into a table: for each 9 bit
+// pixel value and each of the 3 phases a pixel can start on, the RGB that
+// its first half, whole, and second half add to an output pixel. a row is
+// then two table lookups and a saturating add per output pixel.
+
+const float NTSC_LEVELS[8] = {
+  0.350f, 0.518f, 0.962f, 1.550f, // low half of the wave, per luma level
+  1.094f, 1.506f, 1.962f, 1.962f // high half
+};
+const float NTSC_BLACK = 0.518f;
+const float NTSC_WHITE = 1.962f;
+const float NTSC_ATTENUATION = 0.746f;
+// decoder settings, tuned so flat colors come out close to PALETTE
+const float NTSC_HUE = 4.0f; // phase offset in samples
+const float NTSC_SATURATION = 2.0f; // a demodulated square wave comes out at half amplitude
+const uint16_t NTSC_EDGE = 0x0f; // what's beyond the left and right edge, black
+
+// the signal for a pixel value (index | emphasis << 6) at a sample phase
+float ntsc_signal(int value, int phase) {
+  int color = value & 0x0f;
+  int level = (value >> 4) & 0x3;
+  int emphasis = value >> 6;
+  if (color > 13) {
+    level = 1;
+  }
+  float low = NTSC_LEVELS[level];
+  float high = NTSC_LEVELS[4 + level];
+  if (color == 0) {
+    low = high;
+  }
+  if (color > 12) {
+    high = low;
+  }
+  auto in_phase = [phase](int color) { return (color + phase) % 12 < 6; };
+  float signal = in_phase(color) ? high : low;
+  if (((emphasis & 1) && in_phase(0)) ||
+      ((emphasis & 2) && in_phase(4)) ||
+      ((emphasis & 4) && in_phase(8))) {
+    signal *= NTSC_ATTENUATION;
+  }
+  return (signal - NTSC_BLACK) / (NTSC_WHITE - NTSC_BLACK);
+}
+
+// BGR0 contributions of one source pixel, 0..255 scale
+struct NtscEntry {
+  int16_t head[4]; // samples 0..3, to the output pixel left of it
+  int16_t whole[4]; // all 8, to both of its own output pixels
+  int16_t tail[4]; // samples 4..7, to the output pixel right of it
+  int16_t unused[4];
+};
+
+class NtscFilter {
+  public:
+  bool initialized = false;
+
+  ~NtscFilter() {
+    delete[] table;
+  }
+
+  void initialize();
+  void render_row(const uint16_t*, uint32_t*, int);
+
+  private:
+  NtscEntry (*table)[512] = nullptr; // 48KB, by start phase / 4, then value
+};
+
+void NtscFilter::initialize() {
+  table = new NtscEntry[3][512];
+  for (int phase = 0; phase < 3; ++phase) {
+    for (int value = 0; value < 512; ++value) {
+      float y[2] = {0, 0}, i[2] = {0, 0}, q[2] = {0, 0}; // first half, second half
+      for (int k = 0; k < 8; ++k) {
+        int sample = 4 * phase + k;
+        float level = ntsc_signal(value, sample) / 12;
+        float angle = M_PI * (sample + NTSC_HUE) / 6;
+        y[k / 4] += level;
+        i[k / 4] += level * cos(angle);
+        q[k / 4] += level * sin(angle);
+      }
+      NtscEntry& entry = table[phase][value];
+      for (int half = 0; half < 3; ++half) {
+        // half 2 is the whole pixel
+        float py = half == 2 ? y[0] + y[1] : y[half];
+        float pi = NTSC_SATURATION * (half == 2 ? i[0] + i[1] : i[half]);
+        float pq = NTSC_SATURATION * (half == 2 ? q[0] + q[1] : q[half]);
+        float rgb[3] = {
+          py + 0.946882f * pi + 0.623557f * pq,
+          py - 0.274788f * pi - 0.635691f * pq,
+          py - 1.108545f * pi + 1.709007f * pq
+        };
+        int16_t* out = half == 0 ? entry.head : half == 1 ? entry.tail : entry.whole;
+        for (int c = 0; c < 3; ++c) {
+          out[2 - c] = lrintf(255 * rgb[c]);
+        }
+        out[3] = 0;
+      }
+      memset(entry.unused, 0, sizeof(entry.unused));
+    }
+  }
+  initialized = true;
+}
+
+// one row of 256 pixel values into 512 BGRA pixels. phase is where the row
+// starts in the color cycle, 0..2 in units of 4 samples
+void NtscFilter::render_row(const uint16_t* values, uint32_t* out, int phase) {
+  // a pixel starts 8 samples after the last one, so the phase steps by 2
+  const NtscEntry* pixel[256 + 2];
+  for (int x = 0; x < 256; ++x) {
+    pixel[x + 1] = &table[(phase + 2 * x) % 3][values[x] & 0x1ff];
+  }
+  pixel[0] = &table[(phase + 1) % 3][NTSC_EDGE];
+  pixel[257] = &table[(phase + 2) % 3][NTSC_EDGE];
+
+  int x = 0;
+#ifdef __SSE2__
+  const __m128i alpha = _mm_set1_epi32(0xff000000);
+  for (; x + 2 <= 256; x += 2) {
+    __m128i sums[2];
+    for (int k = 0; k < 2; ++k) {
+      const NtscEntry* left = pixel[x + k];
+      const NtscEntry* middle = pixel[x + k + 1];
+      const NtscEntry* right = pixel[x + k + 2];
+      __m128i whole = _mm_loadl_epi64((const __m128i*) middle->whole);
+      __m128i edges = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*) left->tail),
+                                         _mm_loadl_epi64((const __m128i*) right->head));
+      sums[k] = _mm_adds_epi16(_mm_unpacklo_epi64(whole, whole), edges);
+    }
+    _mm_storeu_si128((__m128i*) (out + 2 * x),
+                     _mm_or_si128(_mm_packus_epi16(sums[0], sums[1]), alpha));
+  }
+#endif
+  for (; x < 256; ++x) {
+    const NtscEntry* left = pixel[x];
+    const NtscEntry* middle = pixel[x + 1];
+    const NtscEntry* right = pixel[x + 2];
+    for (int half = 0; half < 2; ++half) {
+      const int16_t* edge = half == 0 ? left->tail : right->head;
+      uint32_t color = 0xff000000;
+      for (int c = 0; c < 3; ++c) {
+        int value = middle->whole[c] + edge[c];
+        color |= (uint32_t) (value < 0 ? 0 : value > 255 ? 255 : value) << (8 * c);
+      }
+      out[2 * x + half] = color;
+    }
+  }
+}
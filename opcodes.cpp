@@ -18,6 +18,17 @@ enum CPUFunction {
   TAS, SHY, SHX, LAS
 };
 
+// mnemonics in the same order as CPUFunction
+const char* FUNCTION_NAMES[] = {
+  "ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BRK",
+  "BVC", "BVS", "CLC", "CLD", "CLI", "CLV", "CMP", "CPX", "CPY", "DEC", "DEX",
+  "DEY", "EOR", "INC", "INX", "INY", "JMP", "JSR", "LDA", "LDX", "LDY", "LSR",
+  "NOP", "ORA", "PHA", "PHP", "PLA", "PLP", "ROL", "ROR", "RTI", "RTS", "SBC",
+  "SEC", "SED", "SEI", "STA", "STX", "STY", "TAX", "TAY", "TSX", "TXA", "TXS",
+  "TYA", "ISB", "SLO", "RLA", "SRE", "RRA", "DCP", "LAX", "AHX", "STP", "SAX",
+  "TAS", "SHY", "SHX", "LAS"
+};
+
 enum AddressingMode {
   IMPLIED, IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X,
   ZERO_PAGE_Y, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y,
@@ -99,6 +110,9 @@ class OpcodeGenerator {
     void set_addressing_mode(Opcode& op);
     void set_length_cycles(Opcode& op);
     void set_instruction(Opcode& op);
+
+  private:
+    Opcode* build_table();
 };
 
 void OpcodeGenerator::set_addressing_mode(Opcode& op) {
@@ -155,7 +169,14 @@ void OpcodeGenerator::set_instruction(Opcode& op) {
   }
 }
 
+// the table never changes, so it is built by the first call and shared.
+// that first initialization is thread safe, for machines started in parallel
 Opcode* OpcodeGenerator::generate_all_opcodes() {
+  static Opcode* all_opcodes = build_table();
+  return all_opcodes;
+}
+
+Opcode* OpcodeGenerator::build_table() {
   static Opcode all_opcodes[256];
   for (int i = 0; i <= 0xff; ++i) {
     Opcode current = all_opcodes[i];
@@ -71,3 +71,34 @@ struct Color PALETTE[64] = {
 	{ 0x00,0x00,0x00 },
 	{ 0x00,0x00,0x00 },
  };
+
+// emphasis darkens the two color components it doesn't name
+const double EMPHASIS_ATTENUATION = 0.816328;
+
+// PALETTE as 32-bit ARGB, the framebuffer's format (BGRA bytes in memory),
+// for each combination of the $2001 emphasis bits: colors[emphasis << 6 | color]
+struct PaletteArgb {
+  uint32_t colors[512];
+
+  PaletteArgb() {
+    for (int emphasis = 0; emphasis < 8; ++emphasis) {
+      for (int color = 0; color < 64; ++color) {
+        // $2001 bit 5 emphasizes red, 6 green and 7 blue
+        uint8_t components[3] = {PALETTE[color].red, PALETTE[color].green, PALETTE[color].blue};
+        uint32_t argb = 0xff000000;
+        for (int c = 0; c < 3; ++c) {
+          double value = components[c];
+          for (int bit = 0; bit < 3; ++bit) {
+            if (((emphasis >> bit) & 0x1) && bit != c) {
+              value *= EMPHASIS_ATTENUATION;
+            }
+          }
+          argb |= (uint32_t) (value + 0.5) << (16 - 8 * c);
+        }
+        colors[emphasis << 6 | color] = argb;
+      }
+    }
+  }
+};
+
+const PaletteArgb PALETTE_ARGB;
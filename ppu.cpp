@@ -12,11 +12,30 @@ void PPU::set_cpu(CPU* cpu_pointer) {
   cpu = cpu_pointer;
 }
 
-void PPU::set_gui(GUI* gui_ptr) {
-  gui = gui_ptr;
+void PPU::set_frontend(Frontend* frontend_ptr) {
+  frontend = frontend_ptr;
+}
+
+PPU::~PPU() {
+  delete[] framebuffer;
+  delete[] pixels;
+}
+
+// output stays pointed at a caller's buffer if it has one
+void PPU::allocate_frame() {
+  if (framebuffer == nullptr) {
+    framebuffer = new uint8_t[256 * 240 * 4]();
+  }
+  if (pixels == nullptr) {
+    pixels = new uint16_t[256 * 240]();
+  }
+  if (output == nullptr) {
+    output = framebuffer;
+  }
 }
 
 void PPU::initialize() {
+  frames = 0;
   previous_scanline = 241;
   previous_tick = 0;
   local_clock = 0;
@@ -25,6 +44,33 @@ void PPU::initialize() {
   reg2000.value = 0;
   reg2001.value = 0;
   reg2002.value = 0;
+  oamaddr = 0;
+  oamdata = 0;
+  scroll_offset = 0;
+  ppuaddr = 0;
+  ppudata = 0;
+  total_ppuaddr = 0;
+  palette_dirty = true;
+}
+
+// the framebuffer is output, not state, and is left alone
+void PPU::transfer_state(SaveState& state) {
+  state.transfer(previous_tick);
+  state.transfer(previous_scanline);
+  state.transfer(current_scanline);
+  state.transfer(current_tick);
+  state.transfer(local_clock);
+  state.transfer(reg2000);
+  state.transfer(reg2001);
+  state.transfer(reg2002);
+  state.transfer(oamaddr);
+  state.transfer(oamdata);
+  state.transfer(scroll_offset);
+  state.transfer(ppuaddr);
+  state.transfer(ppudata);
+  state.transfer(total_ppuaddr);
+  state.transfer(frames);
+  palette_dirty = true; // palette RAM may have been loaded too
 }
 
 uint8_t PPU::read_register(uint8_t reg) {
@@ -67,6 +113,7 @@ void PPU::write_register(uint8_t reg, uint8_t val) {
 
     case 1:
       reg2001.value = val;
+      palette_dirty = true;
       break;
 
     case 2:
@@ -93,6 +140,9 @@ void PPU::write_register(uint8_t reg, uint8_t val) {
 
     case 7:
       ppu_memory->write(total_ppuaddr, val);
+      if ((total_ppuaddr & 0x3fff) >= 0x3f00) {
+        palette_dirty = true;
+      }
       if (reg2000.reg_data.vram_address_increment) {
         total_ppuaddr += 32;
       } else {
@@ -135,115 +185,152 @@ void PPU::step_to(uint64_t cycle) {
 
     // TODO: have cycle-accurate memory accesses & render during "VBlank" LOL
     if (current_scanline == 0) {
-      // TODO: separate bg rendering into another function
-      if (reg2001.reg_data.background) {
-        struct Color palette[4];
-        // render background
-        for (int i = 0; i < 30; ++i) {
-          for (int j = 0; j < 32; ++j) {
-            uint8_t chr_ind = ppu_memory->read(0x2000 + i * 0x20 + j);
-            int memory_ind = chr_ind * 16 + 0x1000 * reg2000.reg_data.bg_pattern_table_address;
-            write_background_tile_palette(palette, j << 3, i << 3);
-            // each line of tile
-            for (int k = 0; k < 8; ++k) {
-              uint8_t lower_data = ppu_memory->read(memory_ind + k);
-              uint8_t upper_data = ppu_memory->read(memory_ind + 8 + k);
-              // each pixel of each line
-              for (int l = 7; l >= 0; l--) {
-                uint8_t palette_ind = ((upper_data & 0x1) << 1) | (lower_data & 0x1);
-                write_to_framebuffer(framebuffer, 8 * j + l, 8 * i + k, palette[palette_ind]);
-                upper_data >>= 1;
-                lower_data >>= 1;
-              }
-            }
+      if (render_enabled) {
+        if (output == nullptr) {
+          allocate_frame();
+        } else if (pixels == nullptr) {
+          pixels = new uint16_t[256 * 240](); // drawing elsewhere, framebuffer isn't needed
+        }
+        {
+          ScopedTimer timer(timing, STAGE_RENDER);
+          render_background();
+          render_sprites();
+        }
+        if (frontend) {
+          frontend->render_frame(output);
+        }
+      } else if (frontend) {
+        frontend->handle_events();
+      }
+      frames++;
+    }
+  }
+  previous_scanline = current_scanline;
+  previous_tick = current_tick;
+}
+
+void PPU::render_background() {
+  if (palette_dirty) {
+    resolve_palette();
+  }
+  if (reg2001.reg_data.background) {
+    uint8_t palette[4];
+    // render background
+    for (int i = 0; i < 30; ++i) {
+      for (int j = 0; j < 32; ++j) {
+        uint8_t chr_ind = ppu_memory->read(0x2000 + i * 0x20 + j);
+        int memory_ind = chr_ind * 16 + 0x1000 * reg2000.reg_data.bg_pattern_table_address;
+        write_background_tile_palette(palette, j << 3, i << 3);
+        // each line of tile
+        for (int k = 0; k < 8; ++k) {
+          uint8_t lower_data = ppu_memory->read(memory_ind + k);
+          uint8_t upper_data = ppu_memory->read(memory_ind + 8 + k);
+          // each pixel of each line
+          for (int l = 7; l >= 0; l--) {
+            uint8_t palette_ind = ((upper_data & 0x1) << 1) | (lower_data & 0x1);
+            write_to_framebuffer(output, 8 * j + l, 8 * i + k, palette[palette_ind]);
+            upper_data >>= 1;
+            lower_data >>= 1;
           }
         }
       }
-      // TODO: separate sprite rendering into another function
-      // TODO: 8x16 sprite size
-      if (reg2001.reg_data.sprites) {
-        // render sprites
-        // TODO: use a bitfield and / or structs for this
-        uint8_t* oam = ppu_memory->oam;
-        for (int sprite = 63; sprite >= 0; --sprite) {
-          uint8_t y_pos = oam[4 * sprite];
-          uint8_t tile_index = oam[4 * sprite + 1];
-          // TODO: fix this ugly with union
-          struct SpriteAttributes attributes = *(struct SpriteAttributes *) (oam + 4 * sprite + 2);
-          uint8_t x_pos = oam[4 * sprite + 3];
-          if (y_pos > 0xEF || x_pos > 0xF9) {
-            continue; // overflow sprites not shown
+    }
+  } else {
+    // the backdrop color shows instead. this also means every drawn frame
+    // covers the whole output, which may be a different buffer each frame
+    for (int y = 0; y < 240; ++y) {
+      for (int x = 0; x < 256; ++x) {
+        write_to_framebuffer(output, x, y, 0);
+      }
+    }
+  }
+}
+
+void PPU::render_sprites() {
+  // TODO: 8x16 sprite size
+  if (reg2001.reg_data.sprites) {
+    // render sprites
+    // TODO: use a bitfield and / or structs for this
+    uint8_t* oam = ppu_memory->oam;
+    for (int sprite = 63; sprite >= 0; --sprite) {
+      uint8_t y_pos = oam[4 * sprite];
+      uint8_t tile_index = oam[4 * sprite + 1];
+      // TODO: fix this ugly with union
+      struct SpriteAttributes attributes = *(struct SpriteAttributes *) (oam + 4 * sprite + 2);
+      uint8_t x_pos = oam[4 * sprite + 3];
+      if (y_pos > 0xEF || x_pos > 0xF9) {
+        continue; // overflow sprites not shown
+      }
+      int memory_ind = tile_index * 16 + 0x1000 * reg2000.reg_data.sprite_pattern_table_address;
+      uint8_t palette[4];
+      write_sprite_tile_palette(palette, attributes.palette);
+      // each line of each tile
+      for (int k = 0; k < 8; ++k) {
+        uint8_t lower_data = ppu_memory->read(memory_ind + k);
+        uint8_t upper_data = ppu_memory->read(memory_ind + 8 + k);
+        // each pixel of each line
+        for (int l = 7; l >= 0; l--) {
+          int x, y;
+          if (attributes.flip_horizontal) {
+            x = x_pos + (8 - l);
+          } else {
+            x = x_pos + l;
+          }
+          if (attributes.flip_vertical) {
+            y = y_pos + (8 - k);
+          } else {
+            y = y_pos + k;
           }
-          int memory_ind = tile_index * 16 + 0x1000 * reg2000.reg_data.sprite_pattern_table_address;
-          struct Color palette[4];
-          write_sprite_tile_palette(palette, attributes.palette);
-          // each line of each tile
-          for (int k = 0; k < 8; ++k) {
-            uint8_t lower_data = ppu_memory->read(memory_ind + k);
-            uint8_t upper_data = ppu_memory->read(memory_ind + 8 + k);
-            // each pixel of each line
-            for (int l = 7; l >= 0; l--) {
-              int x, y;
-              if (attributes.flip_horizontal) {
-                x = x_pos + (8 - l);
-              } else {
-                x = x_pos + l;
-              }
-              if (attributes.flip_vertical) {
-                y = y_pos + (8 - k);
-              } else {
-                y = y_pos + k;
-              }
-              uint8_t palette_ind = ((upper_data & 0x1) << 1) | (lower_data & 0x1);
-              if (palette_ind != 0) {
-                write_to_framebuffer(framebuffer, x, y, palette[palette_ind]);
-              }
-              upper_data >>= 1;
-              lower_data >>= 1;
-            }
+          uint8_t palette_ind = ((upper_data & 0x1) << 1) | (lower_data & 0x1);
+          if (palette_ind != 0) {
+            write_to_framebuffer(output, x, y, palette[palette_ind]);
           }
+          upper_data >>= 1;
+          lower_data >>= 1;
         }
       }
-      frames++;
-      gui->render_frame(framebuffer);
     }
   }
-  previous_scanline = current_scanline;
-  previous_tick = current_tick;
 }
 
-void PPU::write_sprite_tile_palette(struct Color* palette, uint8_t palette_ind) {
-  uint8_t color_ind;
+void PPU::resolve_palette() {
+  uint8_t mask = reg2001.reg_data.grayscale ? 0x30 : 0x3f;
+  uint16_t emphasis = (reg2001.value & 0xe0) << 1;
+  for (int i = 0; i < 32; ++i) {
+    uint16_t value = (ppu_memory->read(0x3f00 + i) & mask) | emphasis;
+    palette_pixels[i] = value;
+    palette_colors[i] = PALETTE_ARGB.colors[value];
+  }
+  palette_dirty = false;
+}
+
+// palettes hold palette RAM entries, which write_to_framebuffer() resolves
+void PPU::write_sprite_tile_palette(uint8_t* palette, uint8_t palette_ind) {
   // 0 color is transparent
   for (int i = 1; i < 4; ++i) {
-    color_ind = ppu_memory->read(0x3f10 | (palette_ind << 2) | i);
-    palette[i] = PALETTE[color_ind];
+    palette[i] = 0x10 | (palette_ind << 2) | i;
   }
 }
 
-void PPU::write_background_tile_palette(struct Color* palette, uint8_t x, uint8_t y) {
-  uint8_t color_ind;
-  for (int i = 0; i < 4; ++i) {
-    if (i == 0) {
-      color_ind = ppu_memory->read(0x3f00);
-      palette[0] = PALETTE[color_ind];
-      continue;
-    }
-    uint8_t attribute_offset = ((y >> 5) << 3) + (x >> 5);
-    uint8_t attribute = ppu_memory->read(0x23c0 + attribute_offset);
-    uint8_t x_offset = (x >> 4) & 0x1;
-    uint8_t y_offset = (y >> 4) & 0x1;
-    uint8_t total_offset = (y_offset << 2) | (x_offset << 1);
-    uint8_t palette_ind = (attribute >> total_offset) & 0x3;
-    color_ind = ppu_memory->read(0x3f00 | (palette_ind << 2) | i);
-    palette[i] = PALETTE[color_ind];
+void PPU::write_background_tile_palette(uint8_t* palette, uint8_t x, uint8_t y) {
+  uint8_t attribute_offset = ((y >> 5) << 3) + (x >> 5);
+  uint8_t attribute = ppu_memory->read(0x23c0 + attribute_offset);
+  uint8_t x_offset = (x >> 4) & 0x1;
+  uint8_t y_offset = (y >> 4) & 0x1;
+  uint8_t total_offset = (y_offset << 2) | (x_offset << 1);
+  uint8_t palette_ind = (attribute >> total_offset) & 0x3;
+  palette[0] = 0; // the shared background color
+  for (int i = 1; i < 4; ++i) {
+    palette[i] = (palette_ind << 2) | i;
   }
 }
 
-void PPU::write_to_framebuffer(uint8_t* framebuffer, uint8_t x, uint8_t y, struct Color color) {
-  int index = 4 * (y * 256 + x); // 4 bytes per pixel
-  framebuffer[index] = color.blue;
-  framebuffer[index + 1] = color.green;
-  framebuffer[index + 2] = color.red;
-  framebuffer[index + 3] = 0xff; // no opacity
+// sprites near the bottom reach past row 239
+void PPU::write_to_framebuffer(uint8_t* framebuffer, uint8_t x, uint8_t y, uint8_t entry) {
+  if (y >= 240) {
+    return;
+  }
+  int index = y * 256 + x;
+  pixels[index] = palette_pixels[entry];
+  ((uint32_t*) framebuffer)[index] = palette_colors[entry];
 }
@@ -53,13 +53,16 @@ struct SpriteAttributes {
   bool flip_vertical : 1;
 };
 
-class PPU {
+// registers and clocks first, right after Memory in NES, and the frame
+// buffers last since only drawing touches them
+class alignas(64) PPU {
   public:
   // hardware connections
   Memory* memory;
   CPU* cpu;
   PPUMemory* ppu_memory;
-  GUI* gui;
+  Frontend* frontend = nullptr; // null when running headless
+  FrameTimer* timing = nullptr;
 
   uint16_t previous_tick;
   uint16_t previous_scanline;
@@ -77,27 +80,51 @@ class PPU {
   uint8_t ppuaddr;
   uint8_t ppudata;
 
-  // visual
-  uint8_t framebuffer[256 * 240 * 4];
-  int frames;
+  // $3F00-$3F1F as framebuffer colors and pixels values, with the $2001
+  // emphasis and grayscale bits applied. rebuilt before drawing after
+  // either changes
+  uint32_t palette_colors[32];
+  uint16_t palette_pixels[32];
+  bool palette_dirty;
 
   // latches
   uint16_t total_ppuaddr; // 0 means not set?
 
+  // visual
+  int frames;
+  bool render_enabled = true; // off for skipped frames, which leave both untouched
+  uint8_t* output = nullptr; // where frames are drawn, framebuffer unless the caller has its own
+
+  // 360KB between them, so they're allocated by the first drawn frame or
+  // allocate_frame(), and machines that never draw go without
+  uint8_t* framebuffer = nullptr; // 256x240 BGRA
+  uint16_t* pixels = nullptr; // the same frame as palette indices, emphasis bits above
+
+  // the buffers are freed by ~PPU(), so a copy would free them twice
+  PPU() = default;
+  PPU(const PPU&) = delete;
+  PPU& operator=(const PPU&) = delete;
+  ~PPU();
+  void allocate_frame();
+
   void set_memory(Memory*);
   void set_ppu_memory(PPUMemory*);
   void set_cpu(CPU*);
-  void set_gui(GUI*);
+  void set_frontend(Frontend*);
   void step_to(uint64_t);
   void run_cycle();
   void initialize();
+  void transfer_state(SaveState&);
+  void render_background();
+  void render_sprites();
+  void resolve_palette();
   uint16_t get_current_cycle();
   uint16_t get_current_scanline();
 
 
   uint8_t read_register(uint8_t);
   void write_register(uint8_t, uint8_t);
-  void write_background_tile_palette(Color*, uint8_t, uint8_t);
-  void write_sprite_tile_palette(Color*, uint8_t);
-  void write_to_framebuffer(uint8_t*, uint8_t, uint8_t, Color);
+  void write_background_tile_palette(uint8_t*, uint8_t, uint8_t);
+  void write_sprite_tile_palette(uint8_t*, uint8_t);
+  void write_to_framebuffer(uint8_t*, uint8_t, uint8_t, uint8_t);
 };
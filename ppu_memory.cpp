@@ -6,13 +6,22 @@
 
 using namespace std;
 
-class PPUMemory {
+const int CHR_RAM_SIZE = 0x2000;
+
+class alignas(64) PPUMemory {
 public:
-  uint8_t pattern_tables[0x2000];
+  uint8_t* pattern_tables = nullptr; // the cartridge's CHR ROM, shared and never written, or chr_ram_data
   uint8_t name_tables[0x1000];
   uint8_t palettes[0x20];
   uint8_t spr_ram[0x100];
   uint8_t oam[0x100];
+  bool chr_ram = false; // set by use_chr_ram() for a ROM without CHR data
+  uint8_t* chr_ram_data = nullptr; // CHR_RAM_SIZE, allocated by the first such ROM
+
+  ~PPUMemory();
+  void initialize();
+  void use_chr_ram();
+  void transfer_state(SaveState&);
 
   // memory operations
   uint8_t* get_pointer(uint16_t);
@@ -26,6 +35,38 @@ public:
 };
 
 
+PPUMemory::~PPUMemory() {
+  delete[] chr_ram_data;
+}
+
+// CHR ROM or RAM comes with the ROM, see set_pattern_tables() and use_chr_ram()
+void PPUMemory::initialize() {
+  memset(name_tables, 0, sizeof(name_tables));
+  memset(palettes, 0, sizeof(palettes));
+  memset(spr_ram, 0, sizeof(spr_ram));
+  memset(oam, 0, sizeof(oam));
+}
+
+// pattern tables in cartridge RAM, cleared as at power on
+void PPUMemory::use_chr_ram() {
+  if (chr_ram_data == nullptr) {
+    chr_ram_data = new uint8_t[CHR_RAM_SIZE];
+  }
+  memset(chr_ram_data, 0, CHR_RAM_SIZE);
+  pattern_tables = chr_ram_data;
+  chr_ram = true;
+}
+
+void PPUMemory::transfer_state(SaveState& state) {
+  if (chr_ram) {
+    state.transfer_bytes(chr_ram_data, CHR_RAM_SIZE);
+  }
+  state.transfer(name_tables);
+  state.transfer(palettes);
+  state.transfer(spr_ram);
+  state.transfer(oam);
+}
+
 uint8_t* PPUMemory::get_pointer(uint16_t addr) {
   addr &= 0x3fff;
   if (addr < 0x2000) {
@@ -45,6 +86,9 @@ uint8_t PPUMemory::read(uint16_t ind) {
 }
 
 void PPUMemory::write(uint16_t ind, uint8_t val) {
+  if ((ind & 0x3fff) < 0x2000 && !chr_ram) {
+    return;
+  }
   *(get_pointer(ind)) = val;
 }
 
@@ -53,7 +97,8 @@ uint8_t* PPUMemory::get_spr_pointer(uint8_t addr) {
 }
 
 void PPUMemory::set_pattern_tables(uint8_t* pt_pointer) {
-  memcpy(pattern_tables, pt_pointer, 0x2000);
+  pattern_tables = pt_pointer;
+  chr_ram = false;
 }
 
 void PPUMemory::dma_write_oam(uint8_t* values) {
@@ -0,0 +1,109 @@
+#include <vector>
+#include <algorithm>
+
+const int HOTSPOT_LINES = 64;
+
+Profiler::~Profiler() {
+  delete[] cycles;
+  delete[] executions;
+  delete[] coverage;
+}
+
+void Profiler::initialize(Memory* mem_pointer) {
+  memory = mem_pointer;
+  prg = nullptr;
+  prg_size = 0;
+  delete[] cycles;
+  delete[] executions;
+  delete[] coverage;
+  coverage = nullptr;
+  cycles = new uint64_t[0x10000]();
+  executions = new uint64_t[0x10000]();
+  memset(opcode_cycles, 0, sizeof(opcode_cycles));
+  memset(opcode_executions, 0, sizeof(opcode_executions));
+}
+
+// nothing is marked until the PRG is known
+void Profiler::set_prg(uint8_t* prg_pointer, uint32_t size) {
+  delete[] coverage;
+  prg = prg_pointer;
+  prg_size = size;
+  coverage = new uint8_t[prg_size]();
+}
+
+// hottest PCs by emulated cycles, then every opcode that ran
+bool Profiler::write_report(const char* filename, Opcode* opcodes) {
+  FILE* out = fopen(filename, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  uint64_t total_cycles = 0;
+  vector<uint16_t> pcs;
+  for (int pc = 0; pc < 0x10000; ++pc) {
+    if (executions[pc]) {
+      pcs.push_back(pc);
+      total_cycles += cycles[pc];
+    }
+  }
+  sort(pcs.begin(), pcs.end(), [&](uint16_t a, uint16_t b) {
+    return cycles[a] > cycles[b];
+  });
+
+  fprintf(out, "%lu emulated cycles over %lu distinct PCs\n\n", total_cycles, pcs.size());
+  fprintf(out, "  PC    %%cycles        cycles    executions  instruction\n");
+  for (size_t i = 0; i < pcs.size() && i < HOTSPOT_LINES; ++i) {
+    uint16_t pc = pcs[i];
+    uint8_t bytes[3];
+    for (int j = 0; j < 3; ++j) {
+      bytes[j] = *memory->get_pointer(pc + j);
+    }
+    char assembly[32];
+    disassemble(assembly, sizeof(assembly), opcodes[bytes[0]], pc, bytes);
+    fprintf(out, "  %04X  %6.2f  %12lu  %12lu  %s\n",
+            pc,
+            100.0 * cycles[pc] / total_cycles,
+            cycles[pc],
+            executions[pc],
+            assembly);
+  }
+
+  vector<int> ops;
+  for (int op = 0; op < 256; ++op) {
+    if (opcode_executions[op]) {
+      ops.push_back(op);
+    }
+  }
+  sort(ops.begin(), ops.end(), [&](int a, int b) {
+    return opcode_cycles[a] > opcode_cycles[b];
+  });
+  fprintf(out, "\n  op    %%cycles        cycles    executions  mnemonic\n");
+  for (int op : ops) {
+    fprintf(out, "  %02X    %6.2f  %12lu  %12lu  %s\n",
+            op,
+            100.0 * opcode_cycles[op] / total_cycles,
+            opcode_cycles[op],
+            opcode_executions[op],
+            FUNCTION_NAMES[opcodes[op].instruction]);
+  }
+
+  uint32_t code = 0, data = 0, unused = 0;
+  for (uint32_t i = 0; i < prg_size; ++i) {
+    code += (coverage[i] & COVERAGE_CODE) != 0;
+    data += coverage[i] == COVERAGE_DATA;
+    unused += coverage[i] == 0;
+  }
+  fprintf(out, "\nPRG coverage: %u code, %u data only, %u unused of %u bytes\n",
+          code, data, unused, prg_size);
+  fclose(out);
+  return true;
+}
+
+bool Profiler::write_coverage(const char* filename) {
+  FILE* out = fopen(filename, "wb");
+  if (out == nullptr) {
+    return false;
+  }
+  fwrite(coverage, 1, prg_size, out);
+  fclose(out);
+  return true;
+}
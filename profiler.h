@@ -0,0 +1,51 @@
+// guest code profiler, only built with -DPROFILER (see `make profile`)
+//
+// counts emulated cycles and executions per PC and per opcode, and marks
+// every PRG byte as code, data or unused. the coverage file uses the same
+// bits as an FCEUX code/data log, one byte per PRG byte.
+
+const uint8_t COVERAGE_CODE = 0x1;
+const uint8_t COVERAGE_DATA = 0x2;
+
+class Profiler {
+  public:
+  uint64_t* cycles = nullptr; // per PC
+  uint64_t* executions = nullptr; // per PC
+  uint64_t opcode_cycles[256];
+  uint64_t opcode_executions[256];
+  uint8_t* coverage = nullptr; // per PRG byte
+  uint8_t* prg;
+  uint32_t prg_size;
+  Memory* memory;
+
+  ~Profiler();
+
+  void initialize(Memory*);
+  void set_prg(uint8_t*, uint32_t);
+  bool write_report(const char*, Opcode*);
+  bool write_coverage(const char*);
+
+  // code points at the opcode byte as mapped by the bus
+  void record_instruction(uint8_t* code, uint16_t pc, Opcode& op, uint64_t elapsed) {
+    cycles[pc] += elapsed;
+    executions[pc]++;
+    opcode_cycles[op.opcode] += elapsed;
+    opcode_executions[op.opcode]++;
+    for (int i = 0; i < op.instruction_length; ++i) {
+      mark(code + i, COVERAGE_CODE);
+    }
+  }
+
+  void mark_data(uint8_t* byte) {
+    mark(byte, COVERAGE_DATA);
+  }
+
+  private:
+  void mark(uint8_t* byte, uint8_t kind) {
+    // mirrored NROM-128 banks map to the same PRG byte
+    uintptr_t offset = (uintptr_t) byte - (uintptr_t) prg;
+    if (offset < prg_size) {
+      coverage[offset] |= kind;
+    }
+  }
+};
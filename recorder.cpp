@@ -0,0 +1,290 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// video and audio capture
+//
+// the emulation thread copies each shown frame (and its audio block) into a
+// buffer taken from a fixed pool and queues it; a writer thread does the
+// color conversion and file or pipe I/O. nothing is allocated per frame, and
+// if the writer falls behind and the pool is empty the frame is dropped and
+// counted rather than waiting. video is Y4M, 4:2:0, either to a file or to
+// the stdin of a command given as "|command". audio is 16-bit mono WAV.
+// there is no APU yet, so the audio blocks are silence of the right length.
+
+const int RECORDER_VIDEO_BUFFERS = 8;
+const int RECORDER_AUDIO_BUFFERS = 32;
+const int FRAME_BYTES = 256 * 240 * 4;
+const int PLANE_BYTES = 256 * 240 * 3 / 2; // a frame as 4:2:0 YUV
+const int AUDIO_SAMPLE_RATE = 44100;
+const int AUDIO_BLOCK_SAMPLES = 1024; // more than one frame's worth
+const double NTSC_FRAME_RATE = 39375000.0 / 655171; // 60.0988
+
+enum RecorderJobType {JOB_VIDEO, JOB_AUDIO, JOB_STOP};
+
+struct RecorderJob {
+  RecorderJobType type;
+  int buffer;
+  int samples; // audio only
+};
+
+struct WavHeader {
+  char riff[4];
+  uint32_t riff_size;
+  char wave[4];
+  char fmt[4];
+  uint32_t fmt_size;
+  uint16_t format;
+  uint16_t channels;
+  uint32_t sample_rate;
+  uint32_t byte_rate;
+  uint16_t block_align;
+  uint16_t bits_per_sample;
+  char data[4];
+  uint32_t data_size;
+};
+
+class Recorder {
+  public:
+  bool active = false;
+  atomic<uint64_t> frames_written{0};
+  atomic<uint64_t> frames_dropped{0};
+  atomic<uint64_t> audio_dropped{0};
+
+  bool open_video(const char*);
+  bool open_audio(const char*);
+  void start();
+  void close();
+  void submit_frame(uint8_t*);
+  void submit_audio(int16_t*, int);
+  void end_frame(uint8_t*);
+
+  private:
+  FILE* video = nullptr;
+  bool video_is_pipe = false;
+  FILE* audio = nullptr;
+  uint32_t audio_bytes = 0;
+  double audio_remainder = 0;
+
+  // pools, and a queue of filled buffers, all sized up front
+  uint8_t (*video_buffers)[FRAME_BYTES] = nullptr;
+  int16_t (*audio_buffers)[AUDIO_BLOCK_SAMPLES] = nullptr;
+  int free_video[RECORDER_VIDEO_BUFFERS];
+  int free_video_count = 0;
+  int free_audio[RECORDER_AUDIO_BUFFERS];
+  int free_audio_count = 0;
+  RecorderJob jobs[RECORDER_VIDEO_BUFFERS + RECORDER_AUDIO_BUFFERS + 1];
+  int job_head = 0;
+  int job_count = 0;
+  mutex lock;
+  condition_variable job_ready;
+  thread writer;
+
+  // writer thread only
+  uint8_t* planes = nullptr;
+
+  void push_job(RecorderJob);
+  void run_writer();
+  void write_video(uint8_t*);
+  void write_wav_header();
+};
+
+bool Recorder::open_video(const char* filename) {
+  if (filename[0] == '|') {
+    video = popen(filename + 1, "w");
+    video_is_pipe = true;
+  } else {
+    video = fopen(filename, "wb");
+  }
+  if (video == nullptr) {
+    return false;
+  }
+  // 8:7 pixels, the NTSC frame rate as an exact ratio
+  fprintf(video, "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C420jpeg\n");
+  return true;
+}
+
+bool Recorder::open_audio(const char* filename) {
+  audio = fopen(filename, "wb");
+  if (audio == nullptr) {
+    return false;
+  }
+  write_wav_header(); // sizes are filled in by close()
+  return true;
+}
+
+void Recorder::start() {
+  video_buffers = new uint8_t[RECORDER_VIDEO_BUFFERS][FRAME_BYTES];
+  audio_buffers = new int16_t[RECORDER_AUDIO_BUFFERS][AUDIO_BLOCK_SAMPLES];
+  planes = new uint8_t[PLANE_BYTES];
+  for (int i = 0; i < RECORDER_VIDEO_BUFFERS; ++i) {
+    free_video[i] = i;
+  }
+  for (int i = 0; i < RECORDER_AUDIO_BUFFERS; ++i) {
+    free_audio[i] = i;
+  }
+  free_video_count = RECORDER_VIDEO_BUFFERS;
+  free_audio_count = RECORDER_AUDIO_BUFFERS;
+  active = true;
+  writer = thread(&Recorder::run_writer, this);
+}
+
+// finishes everything already queued, then closes the files
+void Recorder::close() {
+  if (!active) {
+    return;
+  }
+  push_job({JOB_STOP, 0, 0});
+  writer.join();
+  active = false;
+  if (video) {
+    if (video_is_pipe) {
+      pclose(video);
+    } else {
+      fclose(video);
+    }
+    video = nullptr;
+  }
+  if (audio) {
+    fseek(audio, 0, SEEK_SET);
+    write_wav_header();
+    fclose(audio);
+    audio = nullptr;
+  }
+  delete[] video_buffers;
+  delete[] audio_buffers;
+  delete[] planes;
+  video_buffers = nullptr;
+  audio_buffers = nullptr;
+  planes = nullptr;
+}
+
+// never full: every buffer in the pool has at most one job, plus the stop
+void Recorder::push_job(RecorderJob job) {
+  {
+    lock_guard<mutex> guard(lock);
+    jobs[(job_head + job_count) % (sizeof(jobs) / sizeof(jobs[0]))] = job;
+    job_count++;
+  }
+  job_ready.notify_one();
+}
+
+void Recorder::submit_frame(uint8_t* framebuffer) {
+  if (!video) {
+    return;
+  }
+  int buffer;
+  {
+    lock_guard<mutex> guard(lock);
+    if (free_video_count == 0) {
+      frames_dropped++;
+      return;
+    }
+    buffer = free_video[--free_video_count];
+  }
+  memcpy(video_buffers[buffer], framebuffer, FRAME_BYTES);
+  push_job({JOB_VIDEO, buffer, 0});
+}
+
+void Recorder::submit_audio(int16_t* samples, int count) {
+  if (!audio || count > AUDIO_BLOCK_SAMPLES) {
+    return;
+  }
+  int buffer;
+  {
+    lock_guard<mutex> guard(lock);
+    if (free_audio_count == 0) {
+      audio_dropped++;
+      return;
+    }
+    buffer = free_audio[--free_audio_count];
+  }
+  memcpy(audio_buffers[buffer], samples, count * sizeof(int16_t));
+  push_job({JOB_AUDIO, buffer, count});
+}
+
+// one shown frame and the audio that goes with it
+void Recorder::end_frame(uint8_t* framebuffer) {
+  submit_frame(framebuffer);
+  audio_remainder += AUDIO_SAMPLE_RATE / NTSC_FRAME_RATE;
+  int samples = (int) audio_remainder;
+  audio_remainder -= samples;
+  static int16_t silence[AUDIO_BLOCK_SAMPLES];
+  submit_audio(silence, samples);
+}
+
+void Recorder::run_writer() {
+  const int queue_size = sizeof(jobs) / sizeof(jobs[0]);
+  while (true) {
+    RecorderJob job;
+    {
+      unique_lock<mutex> guard(lock);
+      job_ready.wait(guard, [this]() { return job_count > 0; });
+      job = jobs[job_head];
+      job_head = (job_head + 1) % queue_size;
+      job_count--;
+    }
+    if (job.type == JOB_STOP) {
+      return;
+    }
+    if (job.type == JOB_VIDEO) {
+      write_video(video_buffers[job.buffer]);
+      frames_written++;
+    } else {
+      fwrite(audio_buffers[job.buffer], sizeof(int16_t), job.samples, audio);
+      audio_bytes += job.samples * sizeof(int16_t);
+    }
+    lock_guard<mutex> guard(lock);
+    if (job.type == JOB_VIDEO) {
+      free_video[free_video_count++] = job.buffer;
+    } else {
+      free_audio[free_audio_count++] = job.buffer;
+    }
+  }
+}
+
+// BGRA to full range BT.601 4:2:0, chroma averaged over each 2x2 block
+void Recorder::write_video(uint8_t* frame) {
+  uint8_t* y_plane = planes;
+  uint8_t* u_plane = planes + 256 * 240;
+  uint8_t* v_plane = u_plane + 128 * 120;
+  for (int i = 0; i < 256 * 240; ++i) {
+    uint8_t* pixel = frame + i * 4;
+    y_plane[i] = (77 * pixel[2] + 150 * pixel[1] + 29 * pixel[0] + 128) >> 8;
+  }
+  for (int y = 0; y < 120; ++y) {
+    for (int x = 0; x < 128; ++x) {
+      int red = 0, green = 0, blue = 0;
+      for (int k = 0; k < 4; ++k) {
+        uint8_t* pixel = frame + ((2 * y + (k >> 1)) * 256 + 2 * x + (k & 1)) * 4;
+        blue += pixel[0];
+        green += pixel[1];
+        red += pixel[2];
+      }
+      // sums of 4 pixels, hence the extra >> 2. pure blue or red rounds to 256
+      u_plane[y * 128 + x] = min(255, (-43 * red - 85 * green + 128 * blue + (128 << 10) + 512) >> 10);
+      v_plane[y * 128 + x] = min(255, (128 * red - 107 * green - 21 * blue + (128 << 10) + 512) >> 10);
+    }
+  }
+  fputs("FRAME\n", video);
+  fwrite(planes, 1, PLANE_BYTES, video);
+}
+
+void Recorder::write_wav_header() {
+  WavHeader header;
+  memcpy(header.riff, "RIFF", 4);
+  header.riff_size = 36 + audio_bytes;
+  memcpy(header.wave, "WAVE", 4);
+  memcpy(header.fmt, "fmt ", 4);
+  header.fmt_size = 16;
+  header.format = 1; // PCM
+  header.channels = 1;
+  header.sample_rate = AUDIO_SAMPLE_RATE;
+  header.byte_rate = AUDIO_SAMPLE_RATE * sizeof(int16_t);
+  header.block_align = sizeof(int16_t);
+  header.bits_per_sample = 16;
+  memcpy(header.data, "data", 4);
+  header.data_size = audio_bytes;
+  fwrite(&header, sizeof(header), 1, audio);
+}
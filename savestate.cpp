@@ -0,0 +1,59 @@
+#include <vector>
+
+// machine snapshot buffer
+//
+// each component has one transfer_state() that lists its mutable fields in
+// order. the same function saves or loads depending on the buffer's mode,
+// so the two directions can't drift apart. a third mode only lists where
+// the fields are, which is how NES::fork_into() copies one machine's fields
+// straight into another's.
+
+class SaveState {
+  public:
+  vector<uint8_t> data;
+  size_t position = 0;
+  bool loading = false;
+  bool listing = false;
+  vector<pair<uint8_t*, size_t>> fields; // listing, with adjacent fields merged
+
+  void begin_save() {
+    data.clear();
+    position = 0;
+    loading = false;
+    listing = false;
+  }
+
+  void begin_load() {
+    position = 0;
+    loading = true;
+    listing = false;
+  }
+
+  void begin_listing() {
+    fields.clear();
+    position = 0;
+    listing = true;
+  }
+
+  void transfer_bytes(void* value, size_t size) {
+    if (listing) {
+      uint8_t* bytes = (uint8_t*) value;
+      if (!fields.empty() && fields.back().first + fields.back().second == bytes) {
+        fields.back().second += size;
+      } else {
+        fields.push_back({bytes, size});
+      }
+    } else if (loading) {
+      memcpy(value, data.data() + position, size);
+    } else {
+      uint8_t* bytes = (uint8_t*) value;
+      data.insert(data.end(), bytes, bytes + size);
+    }
+    position += size;
+  }
+
+  template <typename T>
+  void transfer(T& value) {
+    transfer_bytes(&value, sizeof(T));
+  }
+};
@@ -0,0 +1,1077 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// pixel art scaling filters
+//
+// the gui hands each frame to submit(), which only copies it; a scaler
+// thread runs the filter in bands of rows spread over a WorkerPool while the
+// next frame is emulated, so the window shows the scaled frame one frame
+// late. if the previous frame is still being scaled the new one is skipped.
+//
+// scale2x/3x are the EPX rules from scale2x.it; scale4x is scale2x applied
+// twice. xbr is Hyllian's xBR with the level 1 (45 degree) edge rule,
+// blending each corner by how much of every output pixel lies past the
+// edge. blend2x/3x/4x borrow hqx's YUV similarity test, but instead of its
+// 256-pattern tables each corner follows one rule over its three neighbours
+// (see blend_corner), so they aren't hqx and don't match its output. all of
+// them work on SSE2 four source pixels at a time, with a scalar tail and
+// fallback that give the same output. ntsc (see ntsc.cpp) works from the palette indices
+// rather than the frame, doubling each line.
+
+enum ScaleFilter {
+  FILTER_NONE,
+  FILTER_SCALE2X, FILTER_SCALE3X, FILTER_SCALE4X,
+  FILTER_BLEND2X, FILTER_BLEND3X, FILTER_BLEND4X,
+  FILTER_XBR2X, FILTER_XBR3X, FILTER_XBR4X,
+  FILTER_NTSC,
+  NUM_FILTERS
+};
+const char* FILTER_NAMES[NUM_FILTERS] = {
+  "none", "scale2x", "scale3x", "scale4x", "blend2x", "blend3x", "blend4x", "xbr2x", "xbr3x", "xbr4x", "ntsc"
+};
+const int FILTER_SCALES[NUM_FILTERS] = {1, 2, 3, 4, 2, 3, 4, 2, 3, 4, 2};
+
+const int SCALER_BANDS = 16; // 15 source rows each
+const int SCALER_PAD = 2; // border the kernels may read past the edge
+const int SCALER_MAX_THREADS = 4;
+
+// an image with its edge pixels repeated SCALER_PAD times all around, so
+// kernels never check bounds
+struct PaddedImage {
+  vector<uint32_t> pixels;
+  int width = 0;
+  int height = 0;
+  int stride = 0;
+
+  void resize(int w, int h) {
+    width = w;
+    height = h;
+    stride = w + 2 * SCALER_PAD;
+    pixels.assign(stride * (h + 2 * SCALER_PAD), 0);
+  }
+
+  uint32_t* row(int y) {
+    return pixels.data() + (y + SCALER_PAD) * stride + SCALER_PAD;
+  }
+
+  void fill_border() {
+    for (int y = 0; y < height; ++y) {
+      uint32_t* line = row(y);
+      for (int i = 1; i <= SCALER_PAD; ++i) {
+        line[-i] = line[0];
+        line[width - 1 + i] = line[width - 1];
+      }
+    }
+    for (int i = 1; i <= SCALER_PAD; ++i) {
+      memcpy(row(-i) - SCALER_PAD, row(0) - SCALER_PAD, stride * sizeof(uint32_t));
+      memcpy(row(height - 1 + i) - SCALER_PAD, row(height - 1) - SCALER_PAD, stride * sizeof(uint32_t));
+    }
+  }
+};
+
+#ifdef __SSE2__
+inline __m128i select_pixels(__m128i mask, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+inline __m128i load4(const uint32_t* pixels) {
+  return _mm_loadu_si128((const __m128i*) pixels);
+}
+
+inline void store4(uint32_t* pixels, __m128i value) {
+  _mm_storeu_si128((__m128i*) pixels, value);
+}
+#endif
+
+// neighbours:  A B C
+//              D E F
+//              G H I
+void scale2x_rows(PaddedImage& src, uint32_t* dst, int dst_stride, int first, int last) {
+  for (int y = first; y < last; ++y) {
+    const uint32_t* above = src.row(y - 1);
+    const uint32_t* line = src.row(y);
+    const uint32_t* below = src.row(y + 1);
+    uint32_t* out0 = dst + 2 * y * dst_stride;
+    uint32_t* out1 = out0 + dst_stride;
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= src.width; x += 4) {
+      __m128i b = load4(above + x);
+      __m128i d = load4(line + x - 1);
+      __m128i e = load4(line + x);
+      __m128i f = load4(line + x + 1);
+      __m128i h = load4(below + x);
+      __m128i edge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)),
+                                      _mm_set1_epi32(-1));
+      __m128i e0 = select_pixels(_mm_and_si128(edge, _mm_cmpeq_epi32(d, b)), d, e);
+      __m128i e1 = select_pixels(_mm_and_si128(edge, _mm_cmpeq_epi32(b, f)), f, e);
+      __m128i e2 = select_pixels(_mm_and_si128(edge, _mm_cmpeq_epi32(d, h)), d, e);
+      __m128i e3 = select_pixels(_mm_and_si128(edge, _mm_cmpeq_epi32(h, f)), f, e);
+      store4(out0 + 2 * x, _mm_unpacklo_epi32(e0, e1));
+      store4(out0 + 2 * x + 4, _mm_unpackhi_epi32(e0, e1));
+      store4(out1 + 2 * x, _mm_unpacklo_epi32(e2, e3));
+      store4(out1 + 2 * x + 4, _mm_unpackhi_epi32(e2, e3));
+    }
+#endif
+    for (; x < src.width; ++x) {
+      uint32_t b = above[x], d = line[x - 1], e = line[x], f = line[x + 1], h = below[x];
+      bool edge = b != h && d != f;
+      out0[2 * x] = edge && d == b ? d : e;
+      out0[2 * x + 1] = edge && b == f ? f : e;
+      out1[2 * x] = edge && d == h ? d : e;
+      out1[2 * x + 1] = edge && h == f ? f : e;
+    }
+  }
+}
+
+void scale3x_rows(PaddedImage& src, uint32_t* dst, int dst_stride, int first, int last) {
+  for (int y = first; y < last; ++y) {
+    const uint32_t* above = src.row(y - 1);
+    const uint32_t* line = src.row(y);
+    const uint32_t* below = src.row(y + 1);
+    uint32_t* out[3] = {
+      dst + 3 * y * dst_stride, dst + (3 * y + 1) * dst_stride, dst + (3 * y + 2) * dst_stride
+    };
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= src.width; x += 4) {
+      __m128i a = load4(above + x - 1), b = load4(above + x), c = load4(above + x + 1);
+      __m128i d = load4(line + x - 1), e = load4(line + x), f = load4(line + x + 1);
+      __m128i g = load4(below + x - 1), h = load4(below + x), i = load4(below + x + 1);
+      __m128i ones = _mm_set1_epi32(-1);
+      __m128i edge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)), ones);
+      __m128i db = _mm_and_si128(edge, _mm_cmpeq_epi32(d, b));
+      __m128i bf = _mm_and_si128(edge, _mm_cmpeq_epi32(b, f));
+      __m128i dh = _mm_and_si128(edge, _mm_cmpeq_epi32(d, h));
+      __m128i hf = _mm_and_si128(edge, _mm_cmpeq_epi32(h, f));
+      __m128i not_a = _mm_andnot_si128(_mm_cmpeq_epi32(e, a), ones);
+      __m128i not_c = _mm_andnot_si128(_mm_cmpeq_epi32(e, c), ones);
+      __m128i not_g = _mm_andnot_si128(_mm_cmpeq_epi32(e, g), ones);
+      __m128i not_i = _mm_andnot_si128(_mm_cmpeq_epi32(e, i), ones);
+      alignas(16) uint32_t results[9][4];
+      store4(results[0], select_pixels(db, d, e));
+      store4(results[1], select_pixels(_mm_or_si128(_mm_and_si128(db, not_c), _mm_and_si128(bf, not_a)), b, e));
+      store4(results[2], select_pixels(bf, f, e));
+      store4(results[3], select_pixels(_mm_or_si128(_mm_and_si128(db, not_g), _mm_and_si128(dh, not_a)), d, e));
+      store4(results[4], e);
+      store4(results[5], select_pixels(_mm_or_si128(_mm_and_si128(bf, not_i), _mm_and_si128(hf, not_c)), f, e));
+      store4(results[6], select_pixels(dh, d, e));
+      store4(results[7], select_pixels(_mm_or_si128(_mm_and_si128(dh, not_i), _mm_and_si128(hf, not_g)), h, e));
+      store4(results[8], select_pixels(hf, f, e));
+      for (int k = 0; k < 4; ++k) {
+        for (int r = 0; r < 3; ++r) {
+          uint32_t* pixel = out[r] + 3 * (x + k);
+          pixel[0] = results[3 * r][k];
+          pixel[1] = results[3 * r + 1][k];
+          pixel[2] = results[3 * r + 2][k];
+        }
+      }
+    }
+#endif
+    for (; x < src.width; ++x) {
+      uint32_t a = above[x - 1], b = above[x], c = above[x + 1];
+      uint32_t d = line[x - 1], e = line[x], f = line[x + 1];
+      uint32_t g = below[x - 1], h = below[x], i = below[x + 1];
+      bool edge = b != h && d != f;
+      bool db = edge && d == b, bf = edge && b == f, dh = edge && d == h, hf = edge && h == f;
+      uint32_t* p0 = out[0] + 3 * x;
+      uint32_t* p1 = out[1] + 3 * x;
+      uint32_t* p2 = out[2] + 3 * x;
+      p0[0] = db ? d : e;
+      p0[1] = (db && e != c) || (bf && e != a) ? b : e;
+      p0[2] = bf ? f : e;
+      p1[0] = (db && e != g) || (dh && e != a) ? d : e;
+      p1[1] = e;
+      p1[2] = (bf && e != i) || (hf && e != c) ? f : e;
+      p2[0] = dh ? d : e;
+      p2[1] = (dh && e != i) || (hf && e != g) ? h : e;
+      p2[2] = hf ? f : e;
+    }
+  }
+}
+
+// packed Y, U and V (8 bits each) for xbr's color distance and hqx's
+// similarity test
+inline uint32_t to_yuv(uint32_t argb) {
+  int r = (argb >> 16) & 0xff, g = (argb >> 8) & 0xff, b = argb & 0xff;
+  int y = (77 * r + 150 * g + 29 * b) >> 8;
+  int u = ((-43 * r - 85 * g + 128 * b) >> 8) + 128;
+  int v = ((128 * r - 107 * g - 21 * b) >> 8) + 128;
+  return (y << 16) | (u << 8) | v;
+}
+
+inline int yuv_distance(uint32_t a, uint32_t b) {
+  return 48 * abs((int) (a >> 16) - (int) (b >> 16)) +
+    7 * abs((int) ((a >> 8) & 0xff) - (int) ((b >> 8) & 0xff)) +
+    6 * abs((int) (a & 0xff) - (int) (b & 0xff));
+}
+
+// hqx's test: past 48 in Y, 7 in U or 6 in V
+inline bool yuv_differs(uint32_t a, uint32_t b) {
+  return abs((int) (a >> 16) - (int) (b >> 16)) > 48 ||
+    abs((int) ((a >> 8) & 0xff) - (int) ((b >> 8) & 0xff)) > 7 ||
+    abs((int) (a & 0xff) - (int) (b & 0xff)) > 6;
+}
+
+inline uint32_t average(uint32_t a, uint32_t b) { // rounded down, per channel
+  return (a & b) + (((a ^ b) & 0xfefefefe) >> 1);
+}
+
+#ifdef __SSE2__
+// the same four pixels at a time. every intermediate fits in 16 bits, so
+// _mm_mullo_epi16 does for the 32 bit multiplies
+inline __m128i to_yuv4(__m128i argb) {
+  __m128i mask = _mm_set1_epi32(0xff);
+  __m128i r = _mm_and_si128(_mm_srli_epi32(argb, 16), mask);
+  __m128i g = _mm_and_si128(_mm_srli_epi32(argb, 8), mask);
+  __m128i b = _mm_and_si128(argb, mask);
+  auto times = [](__m128i value, int factor) { return _mm_mullo_epi16(value, _mm_set1_epi32(factor)); };
+  __m128i y = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(times(r, 77), times(g, 150)), times(b, 29)), 8);
+  __m128i u = _mm_srai_epi32(_mm_sub_epi32(times(b, 128), _mm_add_epi32(times(r, 43), times(g, 85))), 8);
+  __m128i v = _mm_srai_epi32(_mm_sub_epi32(times(r, 128), _mm_add_epi32(times(g, 107), times(b, 21))), 8);
+  u = _mm_add_epi32(u, _mm_set1_epi32(128));
+  v = _mm_add_epi32(v, _mm_set1_epi32(128));
+  return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(y, 16), _mm_slli_epi32(u, 8)), v);
+}
+
+inline __m128i abs_difference(__m128i a, __m128i b) { // per byte
+  return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+inline __m128i yuv_distance4(__m128i a, __m128i b) {
+  __m128i difference = abs_difference(a, b);
+  __m128i yv = _mm_madd_epi16(_mm_and_si128(difference, _mm_set1_epi32(0x00ff00ff)), _mm_set1_epi32(48 << 16 | 6));
+  __m128i u = _mm_and_si128(_mm_srli_epi32(difference, 8), _mm_set1_epi32(0xff));
+  return _mm_add_epi32(yv, _mm_mullo_epi16(u, _mm_set1_epi32(7)));
+}
+
+inline __m128i yuv_differs4(__m128i a, __m128i b) {
+  __m128i past = _mm_subs_epu8(abs_difference(a, b), _mm_set1_epi32(48 << 16 | 7 << 8 | 6));
+  return _mm_andnot_si128(_mm_cmpeq_epi32(past, _mm_setzero_si128()), _mm_set1_epi32(-1));
+}
+
+inline __m128i average4(__m128i a, __m128i b) {
+  __m128i halves = _mm_srli_epi32(_mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi32(0xfefefefe)), 1);
+  return _mm_add_epi32(_mm_and_si128(a, b), halves);
+}
+#endif
+
+// for each corner, how much of each output pixel (out of 256) a color
+// blended into that corner gets. no pixel gets more than 256 in all
+struct CornerWeights {
+  // same order as the corner calls in xbr_rows and blend_rows
+  static constexpr int CORNER_X[4] = {1, -1, -1, 1};
+  static constexpr int CORNER_Y[4] = {1, 1, -1, -1};
+
+  int scale;
+  uint8_t weights[4][4][4]; // corner, row, column
+#ifdef __SSE2__
+  // for write_blocks4(), whose rows are n vectors of four pixels from four
+  // blocks side by side: each vector's weights as two halves of 16 bit
+  // channels, and which corners have any there
+  alignas(16) uint16_t lanes[4][4][4][2][8]; // corner, row, vector, half
+  uint8_t corners[4][4]; // row, vector
+  // at 2x and 4x only the corner whose quarter of the block a pixel is in
+  // reaches it, so there one set of weights does, each from that corner.
+  // these stay a byte a channel, so they mask before they're widened
+  alignas(16) uint8_t owned[4][4][16]; // row, vector
+#endif
+
+  // how much of each output pixel lies past the line joining the
+  // midpoints of the two edges that meet at the corner
+  void initialize_edges(int n) {
+    const int samples = 16;
+    for (int corner = 0; corner < 4; ++corner) {
+      for (int row = 0; row < n; ++row) {
+        for (int column = 0; column < n; ++column) {
+          int inside = 0;
+          for (int sy = 0; sy < samples; ++sy) {
+            for (int sx = 0; sx < samples; ++sx) {
+              double u = (column + (sx + 0.5) / samples) / n - 0.5;
+              double v = (row + (sy + 0.5) / samples) / n - 0.5;
+              inside += CORNER_X[corner] * u + CORNER_Y[corner] * v > 0.5;
+            }
+          }
+          weights[corner][row][column] = min(255, inside * 256 / (samples * samples));
+        }
+      }
+    }
+    finish(n);
+  }
+
+  // a quarter for the corner pixel, and at 4x an eighth for the two next
+  // to it along the edges
+  void initialize_points(int n) {
+    memset(weights, 0, sizeof(weights));
+    for (int corner = 0; corner < 4; ++corner) {
+      int row = CORNER_Y[corner] > 0 ? n - 1 : 0;
+      int column = CORNER_X[corner] > 0 ? n - 1 : 0;
+      weights[corner][row][column] = 64;
+      if (n == 4) {
+        weights[corner][row][column - CORNER_X[corner]] = 32;
+        weights[corner][row - CORNER_Y[corner]][column] = 32;
+      }
+    }
+    finish(n);
+  }
+
+  void finish(int n) {
+    scale = n;
+#ifdef __SSE2__
+    memset(corners, 0, sizeof(corners));
+    for (int corner = 0; corner < 4; ++corner) {
+      for (int row = 0; row < n; ++row) {
+        for (int vector = 0; vector < n; ++vector) {
+          for (int pixel = 0; pixel < 4; ++pixel) {
+            int column = (4 * vector + pixel) % n;
+            int weight = weights[corner][row][column];
+            corners[row][vector] |= (weight != 0) << corner;
+            bool owner = CORNER_X[corner] == (2 * column < n ? -1 : 1) && CORNER_Y[corner] == (2 * row < n ? -1 : 1);
+            for (int channel = 0; channel < 4; ++channel) {
+              lanes[corner][row][vector][pixel / 2][4 * (pixel % 2) + channel] = weight;
+              if (owner) {
+                owned[row][vector][4 * pixel + channel] = weight;
+              }
+            }
+          }
+        }
+      }
+    }
+#endif
+  }
+};
+
+// a test between every pixel and each of its right, lower and two diagonal
+// neighbours: xbr's distance, or the blend mask of whether they differ. the
+// corners look at each pair from both sides, so it's computed once here
+struct PairTests {
+  PaddedImage right; // with (x + 1, y)
+  PaddedImage below; // with (x, y + 1)
+  PaddedImage down; // with (x + 1, y + 1)
+  PaddedImage up; // with (x + 1, y - 1)
+
+  void resize(int w, int h) {
+    right.resize(w, h);
+    below.resize(w, h);
+    down.resize(w, h);
+    up.resize(w, h);
+  }
+
+  // rows are padded rows, -SCALER_PAD up to height + SCALER_PAD
+  template <bool differs>
+  void compute(PaddedImage& yuv, int first, int last) {
+    compute_rows<differs>(yuv, right, 1, 0, first, last);
+    compute_rows<differs>(yuv, below, 0, 1, first, last);
+    compute_rows<differs>(yuv, down, 1, 1, first, last);
+    compute_rows<differs>(yuv, up, 1, -1, first, last);
+  }
+
+  // as far as the padding has the neighbour at (dx, dy)
+  template <bool differs>
+  void compute_rows(PaddedImage& yuv, PaddedImage& out, int dx, int dy, int first, int last) {
+    first = max(first, -SCALER_PAD - dy);
+    last = min(last, yuv.height + SCALER_PAD - dy);
+    for (int y = first; y < last; ++y) {
+      uint32_t* line = yuv.row(y) - SCALER_PAD;
+      uint32_t* other = yuv.row(y + dy) - SCALER_PAD + dx;
+      uint32_t* to = out.row(y) - SCALER_PAD;
+      int x = 0;
+#ifdef __SSE2__
+      for (; x + 4 <= yuv.stride - dx; x += 4) {
+        __m128i a = load4(line + x), b = load4(other + x);
+        store4(to + x, differs ? yuv_differs4(a, b) : yuv_distance4(a, b));
+      }
+#endif
+      for (; x < yuv.stride - dx; ++x) {
+        to[x] = differs ? -(uint32_t) yuv_differs(line[x], other[x]) : yuv_distance(line[x], other[x]);
+      }
+    }
+  }
+
+  // (x, y) and a neighbour, from either side
+  inline uint32_t* at(int x, int y, int dx, int dy) {
+    if (dx < 0 || (dx == 0 && dy < 0)) {
+      x += dx;
+      y += dy;
+      dx = -dx;
+      dy = -dy;
+    }
+    if (dy == 0) {
+      return right.row(y) + x;
+    } else if (dx == 0) {
+      return below.row(y) + x;
+    }
+    return dy > 0 ? down.row(y) + x : up.row(y) + x;
+  }
+};
+
+// xbr's rule for the corner between each pixel and its diagonal neighbours,
+// as a mask: blend unless the edges across that diagonal are the weaker.
+// the rule is the same seen from either pixel, so it's decided once per
+// diagonal rather than once per corner
+struct XbrBlends {
+  PaddedImage down; // towards (x + 1, y + 1)
+  PaddedImage up; // towards (x + 1, y - 1)
+
+  void resize(int w, int h) {
+    down.resize(w, h);
+    up.resize(w, h);
+  }
+
+  // rows are padded rows. only the diagonals of the source pixels and the
+  // one row and column of padding before them are needed
+  void compute(PairTests& distances, int first, int last) {
+    compute_rows<1>(distances, down, max(first, -1), min(last, down.height));
+    compute_rows<-1>(distances, up, max(first, 0), min(last, up.height + 1));
+  }
+
+  // same names as in xbr_corner, the diagonal being from E to I (or to C
+  // going up): along are the distances along it, across the other way
+  template <int dy>
+  void compute_rows(PairTests& distances, PaddedImage& out, int first, int last) {
+    PaddedImage& along = dy > 0 ? distances.down : distances.up;
+    PaddedImage& across = dy > 0 ? distances.up : distances.down;
+    for (int y = first; y < last; ++y) {
+      uint32_t* e = across.row(y);
+      uint32_t* next = across.row(y + dy);
+      uint32_t* after = across.row(y + 2 * dy);
+      uint32_t* line = along.row(y);
+      uint32_t* before = along.row(y - dy);
+      uint32_t* beyond = along.row(y + dy);
+      uint32_t* to = out.row(y);
+      int x = -1;
+#ifdef __SSE2__
+      for (; x + 4 <= out.width; x += 4) {
+        __m128i edge = _mm_add_epi32(_mm_add_epi32(load4(e + x), load4(after + x)),
+                                     _mm_add_epi32(load4(next + x - 1), load4(next + x + 1)));
+        edge = _mm_add_epi32(edge, _mm_slli_epi32(load4(next + x), 2));
+        __m128i diagonal = _mm_add_epi32(_mm_add_epi32(load4(line + x - 1), load4(line + x + 1)),
+                                         _mm_add_epi32(load4(before + x), load4(beyond + x)));
+        diagonal = _mm_add_epi32(diagonal, _mm_slli_epi32(load4(line + x), 2));
+        store4(to + x, _mm_cmplt_epi32(edge, diagonal));
+      }
+#endif
+      for (; x < out.width; ++x) {
+        uint32_t edge = e[x] + after[x] + next[x - 1] + next[x + 1] + 4 * next[x];
+        uint32_t diagonal = line[x - 1] + line[x + 1] + before[x] + beyond[x] + 4 * line[x];
+        to[x] = -(uint32_t) (edge < diagonal);
+      }
+    }
+  }
+
+  // the corner of (x, y) towards (x + cx, y + cy)
+  inline uint32_t* at(int x, int y, int cx, int cy) {
+    if (cx < 0) {
+      x += cx;
+      y += cy;
+      cy = -cy;
+    }
+    return cy > 0 ? down.row(y) + x : up.row(y) + x;
+  }
+};
+
+// rows are padded rows, as in PairTests::compute()
+void yuv_rows(PaddedImage& src, PaddedImage& yuv, int first, int last) {
+  for (int y = first; y < last; ++y) {
+    uint32_t* from = src.row(y) - SCALER_PAD;
+    uint32_t* to = yuv.row(y) - SCALER_PAD;
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= yuv.stride; x += 4) {
+      store4(to + x, to_yuv4(load4(from + x)));
+    }
+#endif
+    for (; x < yuv.stride; ++x) {
+      to[x] = to_yuv(from[x]);
+    }
+  }
+}
+
+// the n x n block for e, with each corner's color mixed in by its table's
+// weights, or not at all where the table is null. the mix is one weighted
+// sum per pixel, so the corners' order doesn't matter
+template <int n>
+inline void write_block(uint32_t e, uint32_t* colors, CornerWeights** tables, uint32_t* out, int dst_stride) {
+  if (!tables[0] && !tables[1] && !tables[2] && !tables[3]) {
+    for (int row = 0; row < n; ++row) {
+      for (int column = 0; column < n; ++column) {
+        out[row * dst_stride + column] = e;
+      }
+    }
+    return;
+  }
+  for (int row = 0; row < n; ++row) {
+    for (int column = 0; column < n; ++column) {
+      int rest = 256;
+      uint32_t rb = 0, g = 0;
+      for (int corner = 0; corner < 4; ++corner) {
+        if (tables[corner]) {
+          int weight = tables[corner]->weights[corner][row][column];
+          rest -= weight;
+          rb += (colors[corner] & 0xff00ff) * weight;
+          g += (colors[corner] & 0x00ff00) * weight;
+        }
+      }
+      rb += (e & 0xff00ff) * rest;
+      g += (e & 0x00ff00) * rest;
+      out[row * dst_stride + column] = 0xff000000 | ((rb >> 8) & 0xff00ff) | ((g >> 8) & 0x00ff00);
+    }
+  }
+}
+
+#ifdef __SSE2__
+// the four pixels of vector `part` of a block row, when four blocks of n
+// pixels each sit side by side
+template <int n>
+inline __m128i spread(__m128i lanes, int part) {
+  if (n == 2) {
+    return part == 0 ? _mm_unpacklo_epi32(lanes, lanes) : _mm_unpackhi_epi32(lanes, lanes);
+  } else if (n == 3) {
+    switch (part) {
+      case 0: return _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 0, 0));
+      case 1: return _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 2, 1, 1));
+      default: return _mm_shuffle_epi32(lanes, _MM_SHUFFLE(3, 3, 3, 2));
+    }
+  }
+  switch (part) {
+    case 0: return _mm_shuffle_epi32(lanes, _MM_SHUFFLE(0, 0, 0, 0));
+    case 1: return _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 1, 1, 1));
+    case 2: return _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 2, 2, 2));
+    default: return _mm_shuffle_epi32(lanes, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+}
+
+// the pixels of vector `part` of a block row at 2x and 4x, where the
+// left half of each block is from left and the right half from right
+template <int n, int part>
+inline __m128i owners(__m128i left, __m128i right) {
+  __m128i pairs = part < n / 2 ? _mm_unpacklo_epi32(left, right) : _mm_unpackhi_epi32(left, right);
+  if (n == 2) {
+    return pairs;
+  }
+  if (part % 2 == 0) {
+    return _mm_shuffle_epi32(pairs, _MM_SHUFFLE(1, 1, 0, 0));
+  }
+  return _mm_shuffle_epi32(pairs, _MM_SHUFFLE(3, 3, 2, 2));
+}
+
+// center (widened to 16 bit channels) mixed with color by the weights
+// where the masks are set, as write_block() does
+template <bool with_points>
+inline __m128i mix4(const uint8_t* edge_weights, const uint8_t* point_weights, __m128i* center,
+                    __m128i color, __m128i edge_mask, __m128i point_mask) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i full = _mm_set1_epi16(256);
+  __m128i weights = _mm_and_si128(_mm_load_si128((const __m128i*) edge_weights), edge_mask);
+  if (with_points) {
+    weights = _mm_or_si128(weights, _mm_and_si128(_mm_load_si128((const __m128i*) point_weights), point_mask));
+  }
+  __m128i result[2];
+  for (int half = 0; half < 2; ++half) {
+    __m128i to = half ? _mm_unpackhi_epi8(color, zero) : _mm_unpacklo_epi8(color, zero);
+    __m128i weight = half ? _mm_unpackhi_epi8(weights, zero) : _mm_unpacklo_epi8(weights, zero);
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(to, weight), _mm_mullo_epi16(center[half], _mm_sub_epi16(full, weight)));
+    result[half] = _mm_srli_epi16(sum, 8);
+  }
+  return _mm_or_si128(_mm_packus_epi16(result[0], result[1]), _mm_set1_epi32(0xff000000));
+}
+
+// write_blocks4()'s vector `part` of every row at 2x and 4x. corners 2 and
+// 3 have the top half of each block, 1 and 0 the bottom
+template <int n, bool with_points, int part>
+inline void write_owned4(CornerWeights& edges, CornerWeights& points, __m128i e, __m128i* colors,
+                         __m128i* edge_masks, __m128i* point_masks, uint32_t* out, int dst_stride) {
+  __m128i pixels = spread<n>(e, part);
+  __m128i center[2] = {
+    _mm_unpacklo_epi8(pixels, _mm_setzero_si128()),
+    _mm_unpackhi_epi8(pixels, _mm_setzero_si128()),
+  };
+  __m128i top[3] = {
+    owners<n, part>(colors[2], colors[3]),
+    owners<n, part>(edge_masks[2], edge_masks[3]),
+    with_points ? owners<n, part>(point_masks[2], point_masks[3]) : _mm_setzero_si128(),
+  };
+  __m128i bottom[3] = {
+    owners<n, part>(colors[1], colors[0]),
+    owners<n, part>(edge_masks[1], edge_masks[0]),
+    with_points ? owners<n, part>(point_masks[1], point_masks[0]) : _mm_setzero_si128(),
+  };
+  for (int row = 0; row < n; ++row) {
+    __m128i* quarter = 2 * row < n ? top : bottom;
+    store4(out + row * dst_stride + 4 * part, mix4<with_points>(edges.owned[row][part], points.owned[row][part],
+                                                                center, quarter[0], quarter[1], quarter[2]));
+  }
+}
+
+// write_block() for the four pixels in e, out being the first one's block.
+// a corner's color goes in where its mask in edge_masks is set, by the
+// edges table, or where it is set in point_masks, by the points table
+template <int n, bool with_points>
+inline void write_blocks4(CornerWeights& edges, CornerWeights& points, __m128i e, __m128i* colors,
+                          __m128i* edge_masks, __m128i* point_masks, uint32_t* out, int dst_stride) {
+  __m128i any = _mm_or_si128(_mm_or_si128(edge_masks[0], edge_masks[1]), _mm_or_si128(edge_masks[2], edge_masks[3]));
+  if (with_points) {
+    any = _mm_or_si128(any, _mm_or_si128(_mm_or_si128(point_masks[0], point_masks[1]),
+                                         _mm_or_si128(point_masks[2], point_masks[3])));
+  }
+  if (_mm_movemask_ps(_mm_castsi128_ps(any)) == 0) {
+    for (int part = 0; part < n; ++part) {
+      __m128i pixels = spread<n>(e, part);
+      for (int row = 0; row < n; ++row) {
+        store4(out + row * dst_stride + 4 * part, pixels);
+      }
+    }
+    return;
+  }
+  if (n % 2 == 0) {
+    write_owned4<n, with_points, 0>(edges, points, e, colors, edge_masks, point_masks, out, dst_stride);
+    write_owned4<n, with_points, 1>(edges, points, e, colors, edge_masks, point_masks, out, dst_stride);
+    if (n == 4) {
+      write_owned4<n, with_points, 2>(edges, points, e, colors, edge_masks, point_masks, out, dst_stride);
+      write_owned4<n, with_points, 3>(edges, points, e, colors, edge_masks, point_masks, out, dst_stride);
+    }
+    return;
+  }
+  // at 3x the corners overlap, so each pixel sums over all of them
+  __m128i zero = _mm_setzero_si128();
+  __m128i full = _mm_set1_epi16(256);
+  __m128i alpha = _mm_set1_epi32(0xff000000);
+  for (int part = 0; part < n; ++part) {
+    // everything widened to 16 bits a channel, two pixels to a half
+    __m128i pixels = spread<n>(e, part);
+    __m128i center[2] = {_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero)};
+    __m128i color[4][2], edge[4][2], point[4][2];
+    for (int corner = 0; corner < 4; ++corner) {
+      __m128i spread_color = spread<n>(colors[corner], part);
+      __m128i spread_edge = spread<n>(edge_masks[corner], part);
+      color[corner][0] = _mm_unpacklo_epi8(spread_color, zero);
+      color[corner][1] = _mm_unpackhi_epi8(spread_color, zero);
+      edge[corner][0] = _mm_unpacklo_epi32(spread_edge, spread_edge);
+      edge[corner][1] = _mm_unpackhi_epi32(spread_edge, spread_edge);
+      if (with_points) {
+        __m128i spread_point = spread<n>(point_masks[corner], part);
+        point[corner][0] = _mm_unpacklo_epi32(spread_point, spread_point);
+        point[corner][1] = _mm_unpackhi_epi32(spread_point, spread_point);
+      }
+    }
+    for (int row = 0; row < n; ++row) {
+      int used = edges.corners[row][part] | (with_points ? points.corners[row][part] : 0);
+      __m128i result[2];
+      for (int half = 0; half < 2; ++half) {
+        __m128i sum = zero;
+        __m128i total = zero;
+        for (int corner = 0; corner < 4; ++corner) {
+          if ((used >> corner) & 0x1) {
+            __m128i weight = _mm_and_si128(_mm_load_si128((const __m128i*) edges.lanes[corner][row][part][half]),
+                                           edge[corner][half]);
+            if (with_points) {
+              __m128i extra = _mm_load_si128((const __m128i*) points.lanes[corner][row][part][half]);
+              weight = _mm_or_si128(weight, _mm_and_si128(extra, point[corner][half]));
+            }
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(color[corner][half], weight));
+            total = _mm_add_epi16(total, weight);
+          }
+        }
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(center[half], _mm_sub_epi16(full, total)));
+        result[half] = _mm_srli_epi16(sum, 8);
+      }
+      store4(out + row * dst_stride + 4 * part, _mm_or_si128(_mm_packus_epi16(result[0], result[1]), alpha));
+    }
+  }
+}
+#endif
+
+// the rule for the bottom-right corner, mirrored onto the corner in
+// direction (cx, cy):
+//        A1 B1 C1
+//     A0 A  B  C  C4
+//     D0 D  E  F  F4
+//     G0 G  H  I  I4
+//        G5 H5 I5
+// the corner's color and table for write_block(), or a null table
+template <int cx, int cy>
+inline CornerWeights* xbr_corner(PaddedImage& src, PairTests& distances, XbrBlends& blends,
+                                 CornerWeights& table, int x, int y, uint32_t& color) {
+  uint32_t e = src.row(y)[x];
+  uint32_t f = src.row(y)[x + cx];
+  uint32_t h = src.row(y + cy)[x];
+  if (f == e || h == e || !*blends.at(x, y, cx, cy)) {
+    return nullptr; // the corner would come out as e anyway
+  }
+  color = *distances.at(x, y, cx, 0) <= *distances.at(x, y, 0, cy) ? f : h;
+  return &table;
+}
+
+#ifdef __SSE2__
+// xbr_corner() for the four pixels from x on: the colors, and the mask of
+// the pixels that take them
+template <int cx, int cy>
+inline void xbr_corner4(PaddedImage& src, PairTests& distances, XbrBlends& blends,
+                        int x, int y, __m128i e, __m128i& colors, __m128i& mask) {
+  __m128i f = load4(src.row(y) + x + cx);
+  __m128i h = load4(src.row(y + cy) + x);
+  __m128i same = _mm_or_si128(_mm_cmpeq_epi32(f, e), _mm_cmpeq_epi32(h, e));
+  mask = _mm_andnot_si128(same, load4(blends.at(x, y, cx, cy)));
+  __m128i to_f = load4(distances.at(x, y, cx, 0));
+  __m128i to_h = load4(distances.at(x, y, 0, cy));
+  colors = select_pixels(_mm_cmpgt_epi32(to_f, to_h), h, f);
+}
+#endif
+
+// the scale is a template argument so the per-pixel loops unroll
+template <int n>
+void xbr_rows(PaddedImage& src, PairTests& distances, XbrBlends& blends, CornerWeights& table,
+              uint32_t* dst, int dst_stride, int first, int last) {
+  for (int y = first; y < last; ++y) {
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= src.width; x += 4) {
+      __m128i e = load4(src.row(y) + x);
+      __m128i colors[4], masks[4];
+      xbr_corner4<1, 1>(src, distances, blends, x, y, e, colors[0], masks[0]);
+      xbr_corner4<-1, 1>(src, distances, blends, x, y, e, colors[1], masks[1]);
+      xbr_corner4<-1, -1>(src, distances, blends, x, y, e, colors[2], masks[2]);
+      xbr_corner4<1, -1>(src, distances, blends, x, y, e, colors[3], masks[3]);
+      write_blocks4<n, false>(table, table, e, colors, masks, masks, dst + n * y * dst_stride + n * x, dst_stride);
+    }
+#endif
+    for (; x < src.width; ++x) {
+      uint32_t colors[4];
+      CornerWeights* tables[4] = {
+        xbr_corner<1, 1>(src, distances, blends, table, x, y, colors[0]),
+        xbr_corner<-1, 1>(src, distances, blends, table, x, y, colors[1]),
+        xbr_corner<-1, -1>(src, distances, blends, table, x, y, colors[2]),
+        xbr_corner<1, -1>(src, distances, blends, table, x, y, colors[3]),
+      };
+      write_block<n>(src.row(y)[x], colors, tables, dst + n * y * dst_stride + n * x, dst_stride);
+    }
+  }
+}
+
+// a blend corner, with the same neighbour names as xbr_corner(). where hqx
+// looks up each of the 256 patterns of which neighbours differ from E, this
+// goes by the three pixels around the corner only:
+// - F and H both alike E, or both unlike E and alike each other (an edge
+//   across the corner): their average goes in over the corner's triangle,
+//   as xbr's color would
+// - F and H unlike E and each other: E is a corner of its shape, so only
+//   the corner pixels take a little of I
+// - one of them unlike E: the edge runs straight past, so the corner
+//   pixels take a little of the other
+template <int cx, int cy>
+inline CornerWeights* blend_corner(PaddedImage& src, PairTests& differs, CornerWeights& edges, CornerWeights& points,
+                                int x, int y, uint32_t& color) {
+  uint32_t e = src.row(y)[x];
+  uint32_t f = src.row(y)[x + cx];
+  uint32_t h = src.row(y + cy)[x];
+  bool unlike_f = *differs.at(x, y, cx, 0);
+  bool unlike_h = *differs.at(x, y, 0, cy);
+  bool across = unlike_f == unlike_h && !(unlike_f && *differs.at(x + cx, y, -cx, cy));
+  color = across ? average(f, h) : unlike_f && unlike_h ? src.row(y + cy)[x + cx] : unlike_h ? f : h;
+  if (color == e) {
+    return nullptr;
+  }
+  return across ? &edges : &points;
+}
+
+#ifdef __SSE2__
+// blend_corner() for the four pixels from x on, with a mask for each table
+template <int cx, int cy>
+inline void blend_corner4(PaddedImage& src, PairTests& differs, int x, int y, __m128i e,
+                       __m128i& colors, __m128i& edge_mask, __m128i& point_mask) {
+  __m128i f = load4(src.row(y) + x + cx);
+  __m128i h = load4(src.row(y + cy) + x);
+  __m128i i = load4(src.row(y + cy) + x + cx);
+  __m128i ones = _mm_set1_epi32(-1);
+  __m128i unlike_f = load4(differs.at(x, y, cx, 0));
+  __m128i unlike_h = load4(differs.at(x, y, 0, cy));
+  __m128i shape = _mm_and_si128(_mm_and_si128(unlike_f, unlike_h), load4(differs.at(x + cx, y, -cx, cy)));
+  __m128i across = _mm_andnot_si128(_mm_or_si128(_mm_xor_si128(unlike_f, unlike_h), shape), ones);
+  colors = select_pixels(across, average4(f, h), select_pixels(shape, i, select_pixels(unlike_h, f, h)));
+  __m128i changed = _mm_andnot_si128(_mm_cmpeq_epi32(colors, e), ones);
+  edge_mask = _mm_and_si128(changed, across);
+  point_mask = _mm_andnot_si128(across, changed);
+}
+#endif
+
+template <int n>
+void blend_rows(PaddedImage& src, PairTests& differs, CornerWeights& edges, CornerWeights& points,
+             uint32_t* dst, int dst_stride, int first, int last) {
+  for (int y = first; y < last; ++y) {
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= src.width; x += 4) {
+      __m128i e = load4(src.row(y) + x);
+      __m128i colors[4], edge_masks[4], point_masks[4];
+      blend_corner4<1, 1>(src, differs, x, y, e, colors[0], edge_masks[0], point_masks[0]);
+      blend_corner4<-1, 1>(src, differs, x, y, e, colors[1], edge_masks[1], point_masks[1]);
+      blend_corner4<-1, -1>(src, differs, x, y, e, colors[2], edge_masks[2], point_masks[2]);
+      blend_corner4<1, -1>(src, differs, x, y, e, colors[3], edge_masks[3], point_masks[3]);
+      write_blocks4<n, true>(edges, points, e, colors, edge_masks, point_masks,
+                             dst + n * y * dst_stride + n * x, dst_stride);
+    }
+#endif
+    for (; x < src.width; ++x) {
+      uint32_t colors[4];
+      CornerWeights* tables[4] = {
+        blend_corner<1, 1>(src, differs, edges, points, x, y, colors[0]),
+        blend_corner<-1, 1>(src, differs, edges, points, x, y, colors[1]),
+        blend_corner<-1, -1>(src, differs, edges, points, x, y, colors[2]),
+        blend_corner<1, -1>(src, differs, edges, points, x, y, colors[3]),
+      };
+      write_block<n>(src.row(y)[x], colors, tables, dst + n * y * dst_stride + n * x, dst_stride);
+    }
+  }
+}
+
+class Scaler {
+  public:
+  ScaleFilter filter = FILTER_NONE;
+  uint64_t frames = 0; // frames scaled
+  uint64_t skipped = 0; // frames submitted while the previous one was still busy
+  double last_ns = 0; // time taken by the last frame
+  uint16_t* indices = nullptr; // ppu.pixels, for the ntsc filter
+  int field = 0; // frame parity of the frame being scaled, for the ntsc filter
+
+  ~Scaler() {
+    stop();
+  }
+
+  int scale() {
+    return FILTER_SCALES[filter];
+  }
+
+  void set_filter(ScaleFilter);
+  void submit(uint8_t*);
+  uint32_t* latest();
+  void process(uint32_t*, uint16_t*);
+  void stop();
+
+  private:
+  bool started = false;
+  WorkerPool pool;
+  thread scaler_thread;
+  mutex lock;
+  condition_variable wake;
+  condition_variable idle;
+  bool pending = false;
+  bool busy = false;
+  bool stopping = false;
+
+  vector<uint32_t> submitted; // sized by start(), like the rest
+  vector<uint16_t> submitted_indices;
+  uint64_t submit_count = 0;
+  PaddedImage input;
+  PaddedImage doubled; // scale4x's intermediate
+  PaddedImage yuv;
+  PairTests pairs; // xbr's distances, or blend's masks
+  XbrBlends blends;
+  CornerWeights edge_weights; // xbr's, and blend's across edges
+  CornerWeights point_weights; // blend's otherwise
+  NtscFilter ntsc;
+  vector<uint32_t> output[2]; // double buffered against the gui's upload
+  int writing = 0;
+  int ready = -1;
+
+  void start();
+  void run();
+};
+
+void Scaler::start() {
+  int threads = min<int>(thread::hardware_concurrency(), SCALER_MAX_THREADS);
+  pool.start(max(threads - 1, 0)); // the scaler thread works too
+  submitted.assign(256 * 240, 0);
+  submitted_indices.assign(256 * 240, 0);
+  input.resize(256, 240);
+  doubled.resize(512, 480);
+  yuv.resize(256, 240);
+  pairs.resize(256, 240);
+  blends.resize(256, 240);
+  stopping = false;
+  scaler_thread = thread(&Scaler::run, this);
+  started = true;
+}
+
+void Scaler::stop() {
+  if (!started) {
+    return;
+  }
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  scaler_thread.join();
+  pool.stop();
+  started = false;
+}
+
+// waits for the frame in flight, so buffers can be resized safely
+void Scaler::set_filter(ScaleFilter new_filter) {
+  if (!started) {
+    start();
+  }
+  unique_lock<mutex> guard(lock);
+  idle.wait(guard, [this]() { return !pending && !busy; });
+  filter = new_filter;
+  int size = 256 * scale() * 240 * scale();
+  output[0].assign(size, 0);
+  output[1].assign(size, 0);
+  ready = -1;
+  if (filter >= FILTER_BLEND2X && filter <= FILTER_XBR4X) {
+    edge_weights.initialize_edges(scale());
+    point_weights.initialize_points(scale());
+  }
+  if (filter == FILTER_NTSC && !ntsc.initialized) {
+    ntsc.initialize();
+  }
+}
+
+void Scaler::submit(uint8_t* framebuffer) {
+  submit_count++;
+  {
+    lock_guard<mutex> guard(lock);
+    if (pending || busy) {
+      skipped++;
+      return;
+    }
+  }
+  memcpy(submitted.data(), framebuffer, submitted.size() * sizeof(uint32_t));
+  if (filter == FILTER_NTSC && indices) {
+    memcpy(submitted_indices.data(), indices, submitted_indices.size() * sizeof(uint16_t));
+    field = submit_count & 1;
+  }
+  {
+    lock_guard<mutex> guard(lock);
+    pending = true;
+  }
+  wake.notify_one();
+}
+
+// the newest finished frame, or null before the first one. it stays valid
+// until the next submit() from the same thread
+uint32_t* Scaler::latest() {
+  lock_guard<mutex> guard(lock);
+  return ready >= 0 ? output[ready].data() : nullptr;
+}
+
+void Scaler::run() {
+  while (true) {
+    {
+      unique_lock<mutex> guard(lock);
+      wake.wait(guard, [this]() { return stopping || pending; });
+      if (stopping) {
+        return;
+      }
+      pending = false;
+      busy = true;
+    }
+    auto start = steady_clock::now();
+    process(submitted.data(), submitted_indices.data());
+    last_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    {
+      lock_guard<mutex> guard(lock);
+      ready = writing;
+      writing ^= 1;
+      busy = false;
+      frames++;
+    }
+    idle.notify_all();
+  }
+}
+
+// scales one frame into output[writing] using the pool
+void Scaler::process(uint32_t* frame, uint16_t* values) {
+  if (filter != FILTER_NTSC) {
+    for (int y = 0; y < 240; ++y) {
+      memcpy(input.row(y), frame + 256 * y, 256 * sizeof(uint32_t));
+    }
+    input.fill_border();
+  }
+  uint32_t* out = output[writing].data();
+  int stride = 256 * scale();
+  const int rows = 240 / SCALER_BANDS;
+  auto padded_band = [](int band) {
+    return band * (240 + 2 * SCALER_PAD) / SCALER_BANDS - SCALER_PAD;
+  };
+  switch (filter) {
+    case FILTER_SCALE2X:
+      pool.run(SCALER_BANDS, [&](int band) {
+        scale2x_rows(input, out, stride, band * rows, (band + 1) * rows);
+      });
+      break;
+    case FILTER_SCALE3X:
+      pool.run(SCALER_BANDS, [&](int band) {
+        scale3x_rows(input, out, stride, band * rows, (band + 1) * rows);
+      });
+      break;
+    case FILTER_SCALE4X:
+      pool.run(SCALER_BANDS, [&](int band) {
+        scale2x_rows(input, doubled.row(0), doubled.stride, band * rows, (band + 1) * rows);
+      });
+      doubled.fill_border();
+      pool.run(SCALER_BANDS, [&](int band) {
+        scale2x_rows(doubled, out, stride, 2 * band * rows, 2 * (band + 1) * rows);
+      });
+      break;
+    case FILTER_BLEND2X:
+    case FILTER_BLEND3X:
+    case FILTER_BLEND4X:
+      // three passes, since each reads its neighbours' rows from the last
+      pool.run(SCALER_BANDS, [&](int band) {
+        yuv_rows(input, yuv, padded_band(band), padded_band(band + 1));
+      });
+      pool.run(SCALER_BANDS, [&](int band) {
+        pairs.compute<true>(yuv, padded_band(band), padded_band(band + 1));
+      });
+      pool.run(SCALER_BANDS, [&](int band) {
+        int first = band * rows, last = (band + 1) * rows;
+        if (filter == FILTER_BLEND2X) {
+          blend_rows<2>(input, pairs, edge_weights, point_weights, out, stride, first, last);
+        } else if (filter == FILTER_BLEND3X) {
+          blend_rows<3>(input, pairs, edge_weights, point_weights, out, stride, first, last);
+        } else {
+          blend_rows<4>(input, pairs, edge_weights, point_weights, out, stride, first, last);
+        }
+      });
+      break;
+    case FILTER_XBR2X:
+    case FILTER_XBR3X:
+    case FILTER_XBR4X:
+      // four passes, for the same reason
+      pool.run(SCALER_BANDS, [&](int band) {
+        yuv_rows(input, yuv, padded_band(band), padded_band(band + 1));
+      });
+      pool.run(SCALER_BANDS, [&](int band) {
+        pairs.compute<false>(yuv, padded_band(band), padded_band(band + 1));
+      });
+      pool.run(SCALER_BANDS, [&](int band) {
+        blends.compute(pairs, padded_band(band), padded_band(band + 1));
+      });
+      pool.run(SCALER_BANDS, [&](int band) {
+        int first = band * rows, last = (band + 1) * rows;
+        if (filter == FILTER_XBR2X) {
+          xbr_rows<2>(input, pairs, blends, edge_weights, out, stride, first, last);
+        } else if (filter == FILTER_XBR3X) {
+          xbr_rows<3>(input, pairs, blends, edge_weights, out, stride, first, last);
+        } else {
+          xbr_rows<4>(input, pairs, blends, edge_weights, out, stride, first, last);
+        }
+      });
+      break;
+    case FILTER_NTSC:
+      // the PPU drops a dot every other frame, so rows start on one of two
+      // phases that swap each frame, and each row on the next phase over
+      pool.run(SCALER_BANDS, [&](int band) {
+        for (int y = band * rows; y < (band + 1) * rows; ++y) {
+          uint32_t* line = out + 2 * y * stride;
+          ntsc.render_row(values + 256 * y, line, (y + field) % 3);
+          memcpy(line + stride, line, stride * sizeof(uint32_t));
+        }
+      });
+      break;
+    default:
+      memcpy(out, frame, 256 * 240 * sizeof(uint32_t));
+  }
+}
@@ -0,0 +1,174 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+// on-disk cache of machine snapshots, keyed by ROM and input prefix
+//
+// batch jobs that play many movies sharing a beginning (boot, title screen,
+// menus) spend much of each run emulating it again. with a cache directory,
+// movie keyframes are also written there, named by the ROM hash and a hash
+// of the inputs before them, and playback starts from the latest one its own
+// inputs lead to; see NES::resume_movie(). entries are read through mmap.
+// a hit touches the file, and the least recently used go once there are
+// more than max_entries. several processes may share a directory: entries
+// are written under a temporary name and renamed into place.
+//
+// entry layout: StateCacheHeader, then the state
+
+const char STATE_CACHE_MAGIC[4] = {'N', 'S', 'T', 'C'};
+const uint16_t STATE_CACHE_VERSION = 2;
+const size_t STATE_CACHE_ENTRIES = 4096; // about 60MB of 15KB states
+
+struct StateCacheHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t frame;
+  uint32_t size;
+  uint64_t rom_hash;
+  uint64_t prefix_hash;
+};
+
+class StateCache {
+  public:
+  size_t max_entries = STATE_CACHE_ENTRIES;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t stored = 0;
+  uint64_t evicted = 0;
+
+  bool open(const char*);
+  bool load(uint64_t, uint64_t, uint32_t, SaveState&);
+  void store(uint64_t, uint64_t, uint32_t, SaveState&);
+
+  private:
+  string directory;
+  bool valid = false;
+  size_t entries = 0; // as of the last scan, plus stores since
+
+  string entry_path(uint64_t, uint64_t, uint32_t);
+  void evict();
+};
+
+// creates the directory if needed
+bool StateCache::open(const char* path) {
+  directory = path;
+  mkdir(path, 0777);
+  DIR* dir = opendir(path);
+  if (dir == nullptr) {
+    return false;
+  }
+  entries = 0;
+  while (dirent* entry = readdir(dir)) {
+    entries += has_extension(entry->d_name, ".state");
+  }
+  closedir(dir);
+  valid = true;
+  return true;
+}
+
+string StateCache::entry_path(uint64_t rom_hash, uint64_t prefix_hash, uint32_t frame) {
+  char name[64];
+  snprintf(name, sizeof(name), "/%016lx-%016lx-%u.state", rom_hash, prefix_hash, frame);
+  return directory + name;
+}
+
+// false on a miss or an entry that isn't the one asked for
+bool StateCache::load(uint64_t rom_hash, uint64_t prefix_hash, uint32_t frame, SaveState& state) {
+  if (!valid) {
+    return false;
+  }
+  int fd = ::open(entry_path(rom_hash, prefix_hash, frame).c_str(), O_RDONLY);
+  if (fd < 0) {
+    misses++;
+    return false;
+  }
+  bool found = false;
+  struct stat info;
+  if (fstat(fd, &info) == 0 && (size_t) info.st_size > sizeof(StateCacheHeader)) {
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      StateCacheHeader* header = (StateCacheHeader*) mapped;
+      uint8_t* data = (uint8_t*) mapped + sizeof(StateCacheHeader);
+      found = memcmp(header->magic, STATE_CACHE_MAGIC, 4) == 0 &&
+        header->version == STATE_CACHE_VERSION && header->rom_hash == rom_hash &&
+        header->prefix_hash == prefix_hash && header->frame == frame &&
+        header->size == info.st_size - sizeof(StateCacheHeader);
+      if (found) {
+        state.data.assign(data, data + header->size);
+      }
+      munmap(mapped, info.st_size);
+    }
+  }
+  if (found) {
+    futimens(fd, nullptr); // most recently used
+    hits++;
+  } else {
+    misses++;
+  }
+  ::close(fd);
+  return found;
+}
+
+// keeps whatever is already there, from this run or another
+void StateCache::store(uint64_t rom_hash, uint64_t prefix_hash, uint32_t frame, SaveState& state) {
+  if (!valid) {
+    return;
+  }
+  string path = entry_path(rom_hash, prefix_hash, frame);
+  if (access(path.c_str(), F_OK) == 0) {
+    return;
+  }
+  string temporary = path + "." + to_string(getpid()) + ".tmp";
+  FILE* out = fopen(temporary.c_str(), "wb");
+  if (out == nullptr) {
+    return;
+  }
+  StateCacheHeader header;
+  memcpy(header.magic, STATE_CACHE_MAGIC, 4);
+  header.version = STATE_CACHE_VERSION;
+  header.reserved = 0;
+  header.frame = frame;
+  header.size = state.data.size();
+  header.rom_hash = rom_hash;
+  header.prefix_hash = prefix_hash;
+  bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+    fwrite(state.data.data(), 1, state.data.size(), out) == state.data.size();
+  written = fclose(out) == 0 && written;
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+    remove(temporary.c_str());
+    return;
+  }
+  stored++;
+  if (++entries > max_entries) {
+    evict();
+  }
+}
+
+// down to 7/8 of the limit, so the next stores don't scan again. entries
+// from other processes count and go too
+void StateCache::evict() {
+  vector<pair<int64_t, string>> found; // modification time, name
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+  while (dirent* entry = readdir(dir)) {
+    struct stat info;
+    string path = directory + "/" + entry->d_name;
+    if (has_extension(entry->d_name, ".state") && stat(path.c_str(), &info) == 0) {
+      found.push_back({info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec, path});
+    }
+  }
+  closedir(dir);
+  sort(found.begin(), found.end());
+  size_t keep = max_entries - max_entries / 8;
+  size_t drop = found.size() > keep ? found.size() - keep : 0;
+  for (size_t i = 0; i < drop; ++i) {
+    evicted += remove(found[i].second.c_str()) == 0;
+  }
+  entries = found.size() - drop;
+}
@@ -0,0 +1,292 @@
+// test ROM runner
+//
+// runs every .nes file under a directory (blargg's cpu/ppu/apu suites,
+// instr_timing, sprite_hit and the like) headless, one machine per ROM,
+// spread over all cores, and writes a summary table to stdout and json.
+//
+// a ROM passes in one of two ways:
+// - the $6000 protocol most newer test ROMs speak: $6001-$6003 hold
+//   DE B0 61 once it is in use, $6000 is $80 while running, $81 when it
+//   wants the reset button pressed, and otherwise the result code, 0 for a
+//   pass. $6004 on holds its text output.
+// - a screen hash, for ROMs that only draw their result. screens.txt in
+//   the directory lists "path frames hash" lines; the ROM runs that many
+//   frames and the hash of the last one (palette indices, so palette tweaks
+//   don't matter) has to match. --save-screens writes the hashes of this
+//   run for ROMs without the protocol, to be checked by eye once.
+//
+// anything else is a timeout after --timeout emulated seconds. ROMs with
+// mappers the emulator lacks are listed as skipped.
+
+#include "nes.h"
+#include <algorithm>
+#include <filesystem>
+#include <map>
+
+const int DEFAULT_TIMEOUT_SECONDS = 30;
+const int FRAMES_PER_SECOND = 60;
+const int RESET_DELAY_FRAMES = 10; // the protocol asks for at least 100 ms
+const int STATUS_RUNNING = 0x80;
+const int STATUS_RESET = 0x81;
+const int MAX_TEXT = 160;
+
+enum Outcome {PASS, FAIL, TIMEOUT, CRASH, SKIP};
+const char* OUTCOME_NAMES[] = {"pass", "fail", "timeout", "crash", "skip"};
+
+struct TestResult {
+  string name;
+  Outcome outcome;
+  int code = -1; // $6000 result, -1 for screen hashes and the rest
+  string text;
+  uint32_t frames = 0;
+  uint64_t screen_hash = 0;
+  bool protocol = false;
+  double ms = 0;
+};
+
+struct ExpectedScreen {
+  uint32_t frames;
+  uint64_t hash;
+};
+
+bool read_file(const string& filename, vector<uint8_t>& data) {
+  ifstream file(filename, ios::binary | ios::ate);
+  if (!file) {
+    return false;
+  }
+  data.resize(file.tellg());
+  file.seekg(0, ios::beg);
+  return (bool) file.read((char*) data.data(), data.size());
+}
+
+bool has_protocol(NES& nes) {
+  return nes.memory.prg_ram[1] == 0xde && nes.memory.prg_ram[2] == 0xb0 &&
+    nes.memory.prg_ram[3] == 0x61;
+}
+
+// $6004 on, up to its terminating zero, with newlines kept apart
+string protocol_text(NES& nes) {
+  string text;
+  for (int i = 4; i < 4 + MAX_TEXT && nes.memory.prg_ram[i]; ++i) {
+    char c = nes.memory.prg_ram[i];
+    text += c == '\n' ? ' ' : c;
+  }
+  while (!text.empty() && text.back() == ' ') {
+    text.pop_back();
+  }
+  return text;
+}
+
+void run_test(const string& path, const string& name, uint32_t timeout_frames,
+              map<string, ExpectedScreen>& screens, TestResult& result) {
+  auto start = steady_clock::now();
+  result.name = name;
+  vector<uint8_t> rom;
+  if (!read_file(path, rom) || rom.size() < 0x10) {
+    result.outcome = CRASH;
+    result.text = "could not read ROM";
+    return;
+  }
+  int mapper = (rom[6] >> 4) | (rom[7] & 0xf0);
+  if (mapper != 0) {
+    result.outcome = SKIP;
+    result.text = "mapper " + to_string(mapper);
+    return;
+  }
+  NES* nes = new NES;
+  nes->create_system();
+  if (!nes->load_rom(rom.data(), rom.size())) {
+    result.outcome = SKIP;
+    result.text = "not loadable";
+    delete nes;
+    return;
+  }
+  auto expected = screens.find(name);
+  uint32_t limit = expected != screens.end() ? expected->second.frames : timeout_frames;
+  result.outcome = TIMEOUT;
+  int reset_countdown = -1;
+  for (result.frames = 0; result.frames < limit; ++result.frames) {
+    // only a screen hash needs anything drawn
+    nes->ppu.render_enabled = result.frames + 1 == limit;
+    nes->run_frame();
+    if (!nes->cpu.valid) {
+      result.outcome = CRASH;
+      result.text = "invalid opcode";
+      break;
+    }
+    if (!has_protocol(*nes)) {
+      continue;
+    }
+    result.protocol = true;
+    uint8_t status = nes->memory.prg_ram[0];
+    if (status == STATUS_RESET) {
+      if (reset_countdown < 0) {
+        reset_countdown = RESET_DELAY_FRAMES;
+      } else if (--reset_countdown == 0) {
+        nes->reset();
+        reset_countdown = -1;
+      }
+    } else if (status != STATUS_RUNNING) {
+      result.code = status;
+      result.outcome = status == 0 ? PASS : FAIL;
+      result.text = protocol_text(*nes);
+      result.frames++;
+      break;
+    }
+  }
+  if (result.outcome == TIMEOUT && !result.protocol) {
+    result.screen_hash = xxhash64((uint8_t*) nes->ppu.pixels, 256 * 240 * sizeof(uint16_t));
+    if (expected != screens.end()) {
+      result.outcome = result.screen_hash == expected->second.hash ? PASS : FAIL;
+      result.text = "screen hash";
+    }
+  } else if (result.outcome == TIMEOUT) {
+    result.text = protocol_text(*nes);
+  }
+  delete nes;
+  result.ms = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0;
+}
+
+void read_screens(const string& filename, map<string, ExpectedScreen>& screens) {
+  FILE* in = fopen(filename.c_str(), "r");
+  if (in == nullptr) {
+    return;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), in)) {
+    char name[400];
+    ExpectedScreen screen;
+    unsigned long hash;
+    if (line[0] != '#' && sscanf(line, "%399s %u %lx", name, &screen.frames, &hash) == 3) {
+      screen.hash = hash;
+      screens[name] = screen;
+    }
+  }
+  fclose(in);
+}
+
+void write_screens(const string& filename, vector<TestResult>& results,
+                   map<string, ExpectedScreen>& screens) {
+  for (TestResult& result : results) {
+    if (!result.protocol && (result.outcome == TIMEOUT || result.outcome == FAIL)) {
+      screens[result.name] = {result.frames, result.screen_hash};
+    }
+  }
+  FILE* out = fopen(filename.c_str(), "w");
+  if (out == nullptr) {
+    printf("could not open %s\n", filename.c_str());
+    return;
+  }
+  fprintf(out, "# rom frames hash, see testroms.cpp\n");
+  for (auto& entry : screens) {
+    fprintf(out, "%s %u %016lx\n", entry.first.c_str(), entry.second.frames, entry.second.hash);
+  }
+  fclose(out);
+}
+
+// quotes and backslashes only, test output is plain ASCII
+string json_string(const string& text) {
+  string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += (c >= 0x20 && c < 0x7f) ? c : ' ';
+  }
+  return quoted + "\"";
+}
+
+void write_json(const char* filename, vector<TestResult>& results, double total_ms) {
+  FILE* out = fopen(filename, "w");
+  if (out == nullptr) {
+    printf("could not open %s\n", filename);
+    return;
+  }
+  int counts[5] = {0};
+  for (TestResult& result : results) {
+    counts[result.outcome]++;
+  }
+  fprintf(out, "{\n  \"total_ms\": %.1f,\n", total_ms);
+  for (int i = 0; i < 5; ++i) {
+    fprintf(out, "  \"%s\": %d,\n", OUTCOME_NAMES[i], counts[i]);
+  }
+  fprintf(out, "  \"roms\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    TestResult& result = results[i];
+    fprintf(out, "    {\"name\": %s, \"result\": \"%s\", \"code\": ", json_string(result.name).c_str(),
+            OUTCOME_NAMES[result.outcome]);
+    if (result.code >= 0) {
+      fprintf(out, "%d", result.code);
+    } else {
+      fprintf(out, "null");
+    }
+    fprintf(out, ", \"frames\": %u, \"ms\": %.1f, \"text\": %s}%s\n", result.frames, result.ms,
+            json_string(result.text).c_str(), i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+  fclose(out);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    cout << "Usage: testroms.out DIR results.json [--timeout SECONDS] [--threads N] [--save-screens]\n";
+    return 1;
+  }
+  string directory = argv[1];
+  int timeout_seconds = DEFAULT_TIMEOUT_SECONDS;
+  int threads = max((int) thread::hardware_concurrency(), 1);
+  bool save_screens = false;
+  for (int i = 3; i < argc; ++i) {
+    if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+      timeout_seconds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = max(atoi(argv[++i]), 1);
+    } else if (strcmp(argv[i], "--save-screens") == 0) {
+      save_screens = true;
+    }
+  }
+
+  vector<string> paths;
+  error_code error;
+  for (auto& entry : filesystem::recursive_directory_iterator(directory, error)) {
+    string extension = entry.path().extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (entry.is_regular_file() && extension == ".nes") {
+      paths.push_back(entry.path().string());
+    }
+  }
+  if (error || paths.empty()) {
+    cout << "no .nes files under " << directory << "\n";
+    return 1;
+  }
+  sort(paths.begin(), paths.end());
+  string screens_file = (filesystem::path(directory) / "screens.txt").string();
+  map<string, ExpectedScreen> screens;
+  read_screens(screens_file, screens);
+
+  // longest first would balance better, but the names are all we know
+  vector<TestResult> results(paths.size());
+  WorkerPool pool;
+  pool.start(threads - 1);
+  auto start = steady_clock::now();
+  pool.run(paths.size(), [&](int i) {
+    string name = filesystem::relative(paths[i], directory).string();
+    run_test(paths[i], name, timeout_seconds * FRAMES_PER_SECOND, screens, results[i]);
+  });
+  double total_ms = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0;
+  pool.stop();
+
+  int failures = 0;
+  for (TestResult& result : results) {
+    printf("%-7s %-48s %6u frames  %s\n", OUTCOME_NAMES[result.outcome], result.name.c_str(),
+           result.frames, result.text.c_str());
+    failures += result.outcome == FAIL || result.outcome == TIMEOUT || result.outcome == CRASH;
+  }
+  printf("%lu ROMs, %d not passing, %.1f ms on %d threads\n", results.size(), failures, total_ms,
+         threads);
+  write_json(argv[2], results, total_ms);
+  if (save_screens) {
+    write_screens(screens_file, results, screens);
+  }
+  return failures ? 1 : 0;
+}
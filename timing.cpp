@@ -0,0 +1,286 @@
+// host-side frame timing
+//
+// stages are timed with the cycle counter and summed per frame. the
+// emulation stage (cpu plus ppu stepping) isn't timed directly, since that
+// would mean two counter reads per instruction; it's whatever is left of
+// the frame after the other stages.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t read_ticks() {
+  return __rdtsc();
+}
+#else
+inline uint64_t read_ticks() {
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+enum TimingStage {STAGE_RENDER, STAGE_UPLOAD, STAGE_PRESENT, NUM_STAGES};
+const char* STAGE_NAMES[NUM_STAGES] = {"render", "upload", "present"};
+
+const double NTSC_FRAME_NS = 1e9 / 60.0988;
+const int HISTOGRAM_BUCKET_NS = 100000; // 0.1 ms
+const int HISTOGRAM_BUCKETS = 1000; // the last one also counts anything slower
+const int CSV_FLUSH_FRAMES = 60;
+const int SUMMARY_FRAMES = 600; // the json summary is rewritten every 10 seconds
+
+struct FrameStats {
+  uint64_t frame;
+  double host_ns;
+  double emulation_ns;
+  double stage_ns[NUM_STAGES];
+  uint64_t instructions;
+  uint64_t reads;
+  uint64_t writes;
+  double speed_ratio; // emulated time / host time
+};
+
+class FrameTimer {
+  public:
+  FrameStats last_frame;
+  uint64_t frames = 0;
+  double max_frame_ns = 0;
+  uint32_t* histogram = nullptr; // allocated by the first end_frame()
+
+  ~FrameTimer();
+  void initialize();
+  bool open_csv(const char*);
+  void open_summary(const char*);
+  void close();
+  bool write_summary(const char*);
+  void end_frame(uint64_t, uint64_t, uint64_t);
+  double percentile(double);
+
+  void add(TimingStage stage, uint64_t ticks) {
+    stage_ticks[stage] += ticks;
+  }
+
+  private:
+  double ns_per_tick;
+  uint64_t frame_start;
+  uint64_t stage_ticks[NUM_STAGES];
+  uint64_t previous_instructions;
+  uint64_t previous_reads;
+  uint64_t previous_writes;
+  FILE* csv = nullptr;
+  string summary; // empty when there's none
+};
+
+// adds the lifetime of the object to one stage; timer may be null
+class ScopedTimer {
+  public:
+  ScopedTimer(FrameTimer* frame_timer, TimingStage timed_stage) {
+    timer = frame_timer;
+    stage = timed_stage;
+    start = timer ? read_ticks() : 0;
+  }
+
+  ~ScopedTimer() {
+    if (timer) {
+      timer->add(stage, read_ticks() - start);
+    }
+  }
+
+  private:
+  FrameTimer* timer;
+  TimingStage stage;
+  uint64_t start;
+};
+
+// the cycle counter against the OS clock. this takes 10ms, so it's done
+// once per process rather than per machine
+double calibrate_ticks() {
+  auto clock_start = steady_clock::now();
+  uint64_t ticks_start = read_ticks();
+  while (steady_clock::now() - clock_start < milliseconds(10));
+  double elapsed_ns = duration_cast<nanoseconds>(steady_clock::now() - clock_start).count();
+  return elapsed_ns / (read_ticks() - ticks_start);
+}
+
+FrameTimer::~FrameTimer() {
+  close();
+  delete[] histogram;
+}
+
+void FrameTimer::initialize() {
+  static double calibrated_ns_per_tick = calibrate_ticks();
+  ns_per_tick = calibrated_ns_per_tick;
+
+  frames = 0;
+  max_frame_ns = 0;
+  if (histogram) {
+    memset(histogram, 0, HISTOGRAM_BUCKETS * sizeof(uint32_t));
+  }
+  memset(stage_ticks, 0, sizeof(stage_ticks));
+  memset(&last_frame, 0, sizeof(last_frame));
+  previous_instructions = previous_reads = previous_writes = 0;
+  frame_start = read_ticks();
+}
+
+bool FrameTimer::open_csv(const char* filename) {
+  csv = fopen(filename, "w");
+  if (csv == nullptr) {
+    cout << "could not open timing log " << filename << "\n";
+    return false;
+  }
+  fprintf(csv, "frame,host_ns,emulation_ns");
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    fprintf(csv, ",%s_ns", STAGE_NAMES[i]);
+  }
+  fprintf(csv, ",instructions,reads,writes,speed_ratio\n");
+  return true;
+}
+
+// write_summary() to filename every SUMMARY_FRAMES frames and at close()
+void FrameTimer::open_summary(const char* filename) {
+  summary = filename;
+}
+
+void FrameTimer::close() {
+  if (csv) {
+    fclose(csv);
+    csv = nullptr;
+  }
+  if (!summary.empty()) {
+    write_summary(summary.c_str());
+    summary.clear();
+  }
+}
+
+// totals are running counts since power on, the frame gets the difference
+void FrameTimer::end_frame(uint64_t instructions, uint64_t reads, uint64_t writes) {
+  uint64_t now = read_ticks();
+  FrameStats& stats = last_frame;
+  stats.frame = frames++;
+  stats.host_ns = (now - frame_start) * ns_per_tick;
+  stats.emulation_ns = stats.host_ns;
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    stats.stage_ns[i] = stage_ticks[i] * ns_per_tick;
+    stats.emulation_ns -= stats.stage_ns[i];
+    stage_ticks[i] = 0;
+  }
+  stats.instructions = instructions - previous_instructions;
+  stats.reads = reads - previous_reads;
+  stats.writes = writes - previous_writes;
+  stats.speed_ratio = NTSC_FRAME_NS / stats.host_ns;
+  previous_instructions = instructions;
+  previous_reads = reads;
+  previous_writes = writes;
+
+  // clamped while still a double, since a stall can be past what an int holds
+  double bucket = min(stats.host_ns / HISTOGRAM_BUCKET_NS, (double) HISTOGRAM_BUCKETS - 1);
+  if (histogram == nullptr) {
+    histogram = new uint32_t[HISTOGRAM_BUCKETS]();
+  }
+  histogram[(int) bucket]++;
+  if (stats.host_ns > max_frame_ns) {
+    max_frame_ns = stats.host_ns;
+  }
+
+  if (csv) {
+    fprintf(csv, "%lu,%.0f,%.0f", stats.frame, stats.host_ns, stats.emulation_ns);
+    for (int i = 0; i < NUM_STAGES; ++i) {
+      fprintf(csv, ",%.0f", stats.stage_ns[i]);
+    }
+    fprintf(csv, ",%lu,%lu,%lu,%.3f\n",
+            stats.instructions, stats.reads, stats.writes, stats.speed_ratio);
+    if (frames % CSV_FLUSH_FRAMES == 0) {
+      fflush(csv);
+    }
+  }
+  if (!summary.empty() && frames % SUMMARY_FRAMES == 0) {
+    write_summary(summary.c_str());
+  }
+  frame_start = read_ticks();
+}
+
+// frame time in ns at the given fraction (0.5 for p50), to bucket resolution
+double FrameTimer::percentile(double fraction) {
+  uint64_t target = fraction * frames;
+  uint64_t seen = 0;
+  for (int i = 0; histogram && i < HISTOGRAM_BUCKETS; ++i) {
+    seen += histogram[i];
+    if (seen > target) {
+      return (i + 1) * (double) HISTOGRAM_BUCKET_NS;
+    }
+  }
+  return max_frame_ns;
+}
+
+// written beside the file and renamed over it, so a reader never sees half
+bool FrameTimer::write_summary(const char* filename) {
+  string temporary = string(filename) + ".tmp";
+  FILE* out = fopen(temporary.c_str(), "w");
+  if (out == nullptr) {
+    return false;
+  }
+  fprintf(out, "{\"frames\": %lu, \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f}\n",
+          frames, percentile(0.5), percentile(0.99), max_frame_ns);
+  fclose(out);
+  return rename(temporary.c_str(), filename) == 0;
+}
+
+// frame skipping
+//
+// a skipped frame is still fully emulated, only the framebuffer isn't
+// built or shown, so it costs the cpu plus register and timing work.
+// fixed shows one frame and skips the next interval, which runs interval + 1
+// times faster under vsync. auto skips only while the host is a frame or more
+// behind real time, a few frames in a row at most, and gives up catching up
+// after a long stall (a dragged window, a debugger).
+
+enum FrameSkipMode {FRAMESKIP_OFF, FRAMESKIP_FIXED, FRAMESKIP_AUTO, FRAMESKIP_ALL};
+
+const int FRAMESKIP_MAX_AUTO = 4; // skipped frames in a row
+const int FRAMESKIP_RESYNC_FRAMES = 30;
+
+class FrameSkip {
+  public:
+  FrameSkipMode mode = FRAMESKIP_OFF;
+  int interval = 0;
+  uint64_t skipped = 0;
+
+  void start(FrameSkipMode, int);
+  bool render_next();
+
+  private:
+  int in_a_row = 0;
+  uint64_t frames = 0;
+  steady_clock::time_point start_time;
+};
+
+void FrameSkip::start(FrameSkipMode new_mode, int new_interval) {
+  mode = new_mode;
+  interval = new_interval;
+  in_a_row = 0;
+  frames = 0;
+  start_time = steady_clock::now();
+}
+
+// whether the coming frame should be rendered
+bool FrameSkip::render_next() {
+  bool render = true;
+  if (mode == FRAMESKIP_FIXED) {
+    render = in_a_row >= interval;
+  } else if (mode == FRAMESKIP_ALL) {
+    render = false;
+  } else if (mode == FRAMESKIP_AUTO) {
+    double elapsed_ns = duration_cast<nanoseconds>(steady_clock::now() - start_time).count();
+    double behind_ns = elapsed_ns - frames * NTSC_FRAME_NS;
+    if (behind_ns > FRAMESKIP_RESYNC_FRAMES * NTSC_FRAME_NS) {
+      start_time = steady_clock::now();
+      frames = 0;
+      behind_ns = 0;
+    }
+    render = behind_ns < NTSC_FRAME_NS || in_a_row >= FRAMESKIP_MAX_AUTO;
+  }
+  frames++;
+  if (render) {
+    in_a_row = 0;
+  } else {
+    in_a_row++;
+    skipped++;
+  }
+  return render;
+}
@@ -0,0 +1,152 @@
+// binary instruction trace
+//
+// every executed instruction becomes one fixed-size TraceRecord in a
+// power-of-two ring buffer. with a file attached the ring is flushed in
+// whole blocks as it fills, otherwise it just keeps the most recent records
+// so they can be dumped after something goes wrong. trace_decode.cpp turns
+// the records back into nintendulator-style text.
+
+const char TRACE_MAGIC[4] = {'N', 'T', 'R', 'C'};
+const uint16_t TRACE_VERSION = 1;
+
+struct TraceHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t record_size;
+};
+
+struct TraceRecord {
+  uint16_t pc;
+  uint8_t accumulator;
+  uint8_t x;
+  uint8_t y;
+  uint8_t flags;
+  uint8_t sp;
+  uint8_t length;
+  uint8_t bytes[3];
+  uint8_t unused;
+  uint16_t cycle; // ppu dot within the scanline
+  uint16_t scanline;
+};
+
+static_assert(sizeof(TraceRecord) == 16, "trace records must stay 16 bytes");
+
+class Tracer {
+  public:
+  TraceRecord* records = nullptr;
+  uint32_t mask = 0; // ring size - 1
+  uint64_t count = 0; // records written since initialize()
+  uint64_t flushed = 0; // records already written to file
+  FILE* file = nullptr;
+
+  ~Tracer();
+
+  void initialize(int size_log2);
+  bool open_file(const char*);
+  void close();
+  bool dump(const char*);
+
+  TraceRecord* next_record() {
+    uint32_t slot = count & mask;
+    if (slot == 0 && file && count != flushed) {
+      flush_block();
+    }
+    count++;
+    return records + slot;
+  }
+
+  private:
+  void flush_block();
+  void write_header(FILE*);
+};
+
+Tracer::~Tracer() {
+  close();
+  delete[] records;
+}
+
+void Tracer::initialize(int size_log2) {
+  close();
+  delete[] records;
+  mask = (1u << size_log2) - 1;
+  records = new TraceRecord[mask + 1];
+  count = 0;
+  flushed = 0;
+}
+
+void Tracer::write_header(FILE* out) {
+  TraceHeader header;
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  fwrite(&header, sizeof(header), 1, out);
+}
+
+bool Tracer::open_file(const char* filename) {
+  file = fopen(filename, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  write_header(file);
+  count = 0;
+  flushed = 0;
+  return true;
+}
+
+// called when the ring is about to wrap, so every slot holds an unwritten record
+void Tracer::flush_block() {
+  fwrite(records, sizeof(TraceRecord), mask + 1, file);
+  flushed = count;
+}
+
+// writes out whatever is left in the ring and detaches the file
+void Tracer::close() {
+  if (file) {
+    fwrite(records, sizeof(TraceRecord), count - flushed, file);
+    fclose(file);
+    file = nullptr;
+  }
+}
+
+// writes the ring contents oldest-first, for post-mortem use without a file
+bool Tracer::dump(const char* filename) {
+  FILE* out = fopen(filename, "wb");
+  if (out == nullptr) {
+    return false;
+  }
+  write_header(out);
+  uint64_t size = mask + 1;
+  if (count > size) {
+    uint32_t start = count & mask;
+    fwrite(records + start, sizeof(TraceRecord), size - start, out);
+    fwrite(records, sizeof(TraceRecord), start, out);
+  } else {
+    fwrite(records, sizeof(TraceRecord), count, out);
+  }
+  fclose(out);
+  return true;
+}
+
+// one nintendulator-style line, newline included
+void format_trace_record(char* line, Opcode* opcodes, TraceRecord& record) {
+  Opcode& op = opcodes[record.bytes[0]];
+  char bytes[10];
+  char assembly[32];
+  int written = 0;
+  for (int i = 0; i < record.length; ++i) {
+    written += sprintf(bytes + written, i ? " %02X" : "%02X", record.bytes[i]);
+  }
+  disassemble(assembly, sizeof(assembly), op, record.pc, record.bytes);
+  sprintf(line, "%04X  %-9s%c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%3d SL:%d\n",
+          record.pc,
+          bytes,
+          is_unofficial(op) ? '*' : ' ',
+          assembly,
+          record.accumulator,
+          record.x,
+          record.y,
+          record.flags,
+          record.sp,
+          record.cycle,
+          record.scanline);
+}
@@ -0,0 +1,51 @@
+// offline decoder for binary traces written by Tracer
+// prints one nintendulator/nestest-style line per record, e.g.
+// C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:  0 SL:241
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "opcodes.cpp"
+#include "disassembler.cpp"
+#include "trace.cpp"
+
+const int RECORDS_PER_READ = 4096;
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    printf("Usage: tracedecode.out trace.bin > trace.log\n");
+    return 1;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (in == nullptr) {
+    printf("could not open %s\n", argv[1]);
+    return 1;
+  }
+  TraceHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, 4) != 0 ||
+      header.version != TRACE_VERSION ||
+      header.record_size != sizeof(TraceRecord)) {
+    printf("%s is not a version %d trace\n", argv[1], TRACE_VERSION);
+    return 1;
+  }
+
+  OpcodeGenerator gen;
+  Opcode* opcodes = gen.generate_all_opcodes();
+
+  // records and lines are batched so decoding is bound by fread/fwrite
+  static TraceRecord records[RECORDS_PER_READ];
+  static char output[RECORDS_PER_READ * 96];
+  size_t count;
+  while ((count = fread(records, sizeof(TraceRecord), RECORDS_PER_READ, in)) > 0) {
+    char* line = output;
+    for (size_t i = 0; i < count; ++i) {
+      format_trace_record(line, opcodes, records[i]);
+      line += strlen(line);
+    }
+    fwrite(output, 1, line - output, stdout);
+  }
+  fclose(in);
+  return 0;
+}
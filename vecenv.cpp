@@ -0,0 +1,219 @@
+// many headless emulators stepped in lockstep, for reinforcement learning
+//
+// every instance runs the boot machine's copy of the ROM and starts from its
+// power on state, so reset() is a fork_into(). step() runs each instance on
+// a WorkerPool for action_repeat frames with its action held on pad 1,
+// drawing only the last frame, straight into the caller's buffer. nothing is
+// allocated per step, and instances never get a framebuffer of their own.
+//
+// an instance whose episode ended (the cpu hit an invalid opcode, or
+// max_episode_frames passed) reports done once, with the final observation,
+// and is reset at the start of its next step.
+//
+// with lockstep set, instances are run LOCKSTEP_LANES at a time by a
+// Lockstep (lockstep.cpp) instead, one group per task on the pool. frames
+// and RAM come out exactly the same, only faster while the instances run
+// the same code.
+//
+// `make vecenv` builds libnesvec.so, with the C interface from vecenv.h.
+
+#include "nes.h"
+#include "vecenv.h"
+
+class VecEnv {
+  public:
+  int count = 0;
+  int action_repeat = 4;
+  uint32_t max_episode_frames = 0;
+  bool lockstep = false;
+
+  ~VecEnv() {
+    close();
+  }
+
+  bool initialize(const char*, int, int);
+  void close();
+  void reset(uint8_t*, uint8_t*);
+  void step(const uint8_t*, uint8_t*, uint8_t*, uint8_t*);
+
+  private:
+  NES* envs = nullptr;
+  WorkerPool pool;
+  NES boot;
+  vector<uint8_t> inputs; // two pads per instance
+  vector<uint32_t> episode_frames;
+  vector<uint8_t> ended;
+  vector<Lockstep> groups;
+
+  void reset_one(int);
+  void copy_ram(int, uint8_t*);
+  void begin_step(int, const uint8_t*);
+  void end_step(int, uint8_t*, uint8_t*);
+  void run_group(int, uint8_t*);
+};
+
+bool VecEnv::initialize(const char* rom, int instances, int threads) {
+  if (!ifstream(rom).good() || instances < 1) {
+    return false;
+  }
+  count = instances;
+  envs = new NES[count];
+  inputs.assign(2 * count, 0);
+  episode_frames.assign(count, 0);
+  ended.assign(count, 0);
+  groups.resize((count + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES);
+  boot.create_system();
+  boot.load_program(rom);
+  if (!boot.rom) {
+    return false;
+  }
+  for (int i = 0; i < count; ++i) {
+    NES& nes = envs[i];
+    nes.create_system();
+    nes.share_rom(boot);
+    nes.memory.frame_input = &inputs[2 * i];
+    boot.fork_into(nes); // the first one lists boot's fields, before threads share it
+  }
+  pool.start(max(threads - 1, 0));
+  return true;
+}
+
+void VecEnv::close() {
+  pool.stop();
+  delete[] envs;
+  envs = nullptr;
+  count = 0;
+}
+
+void VecEnv::reset_one(int i) {
+  boot.fork_into(envs[i]);
+  episode_frames[i] = 0;
+  ended[i] = 0;
+}
+
+void VecEnv::copy_ram(int i, uint8_t* ram) {
+  if (ram) {
+    memcpy(ram + i * NESVEC_RAM_BYTES, envs[i].memory.internal_ram, NESVEC_RAM_BYTES);
+  }
+}
+
+void VecEnv::reset(uint8_t* frames, uint8_t* ram) {
+  pool.run(count, [&](int i) {
+    reset_one(i);
+    if (frames) {
+      memset(frames + i * NESVEC_FRAME_BYTES, 0, NESVEC_FRAME_BYTES); // nothing drawn yet
+    }
+    copy_ram(i, ram);
+  });
+}
+
+void VecEnv::begin_step(int i, const uint8_t* actions) {
+  if (ended[i]) {
+    reset_one(i);
+  }
+  inputs[2 * i] = actions[i];
+}
+
+void VecEnv::end_step(int i, uint8_t* ram, uint8_t* done) {
+  NES& nes = envs[i];
+  nes.ppu.output = nullptr;
+  copy_ram(i, ram);
+  ended[i] = !nes.cpu.valid ||
+    (max_episode_frames && episode_frames[i] >= max_episode_frames);
+  if (done) {
+    done[i] = ended[i];
+  }
+}
+
+// the same frames as step() runs one instance at a time, for a group of
+// instances together. one that stops being valid drops out of the later ones
+void VecEnv::run_group(int index, uint8_t* frames) {
+  int first = index * LOCKSTEP_LANES;
+  int last = min(first + LOCKSTEP_LANES, count);
+  for (int repeat = 0; repeat < action_repeat; ++repeat) {
+    NES* running[LOCKSTEP_LANES];
+    int lanes = 0;
+    for (int i = first; i < last; ++i) {
+      NES& nes = envs[i];
+      if (!nes.cpu.valid) {
+        continue;
+      }
+      nes.ppu.render_enabled = frames && repeat == action_repeat - 1;
+      if (nes.ppu.render_enabled) {
+        nes.ppu.output = frames + i * NESVEC_FRAME_BYTES;
+      }
+      episode_frames[i]++;
+      running[lanes++] = &nes;
+    }
+    if (lanes == 0) {
+      break;
+    }
+    groups[index].run_frame(running, lanes);
+  }
+}
+
+void VecEnv::step(const uint8_t* actions, uint8_t* frames, uint8_t* ram, uint8_t* done) {
+  if (lockstep) {
+    pool.run(groups.size(), [&](int index) {
+      int first = index * LOCKSTEP_LANES;
+      int last = min(first + LOCKSTEP_LANES, count);
+      for (int i = first; i < last; ++i) {
+        begin_step(i, actions);
+      }
+      run_group(index, frames);
+      for (int i = first; i < last; ++i) {
+        end_step(i, ram, done);
+      }
+    });
+    return;
+  }
+  pool.run(count, [&](int i) {
+    NES& nes = envs[i];
+    begin_step(i, actions);
+    for (int repeat = 0; repeat < action_repeat && nes.cpu.valid; ++repeat) {
+      bool last = repeat == action_repeat - 1;
+      nes.ppu.render_enabled = frames && last;
+      if (nes.ppu.render_enabled) {
+        nes.ppu.output = frames + i * NESVEC_FRAME_BYTES;
+      }
+      nes.run_frame();
+      episode_frames[i]++;
+    }
+    end_step(i, ram, done);
+  });
+}
+
+extern "C" {
+
+NesVecEnv* nesvec_create(const char* rom, int count, int threads) {
+  VecEnv* env = new VecEnv;
+  if (!env->initialize(rom, count, threads)) {
+    delete env;
+    return nullptr;
+  }
+  return (NesVecEnv*) env;
+}
+
+void nesvec_destroy(NesVecEnv* env) {
+  delete (VecEnv*) env;
+}
+
+void nesvec_configure(NesVecEnv* env, int action_repeat, uint32_t max_episode_frames) {
+  ((VecEnv*) env)->action_repeat = max(action_repeat, 1);
+  ((VecEnv*) env)->max_episode_frames = max_episode_frames;
+}
+
+void nesvec_set_lockstep(NesVecEnv* env, int enabled) {
+  ((VecEnv*) env)->lockstep = enabled;
+}
+
+void nesvec_reset(NesVecEnv* env, uint8_t* frames, uint8_t* ram) {
+  ((VecEnv*) env)->reset(frames, ram);
+}
+
+void nesvec_step(NesVecEnv* env, const uint8_t* actions, uint8_t* frames, uint8_t* ram,
+                 uint8_t* done) {
+  ((VecEnv*) env)->step(actions, frames, ram, done);
+}
+
+}
@@ -0,0 +1,52 @@
+// C interface to vecenv.cpp, for training code that steps many emulators
+// at once (e.g. through ctypes or cffi). see vecenv.cpp for the details.
+//
+// observation buffers are optional (pass null to skip) and hold all
+// instances back to back:
+//   frames  count * NESVEC_FRAME_BYTES, BGRA, 256x240
+//   ram     count * NESVEC_RAM_BYTES, the 2 KB of internal RAM
+// actions is one controller byte per instance, bit 0 A, 1 B, 2 select,
+// 3 start, 4 up, 5 down, 6 left, 7 right. done is one byte per instance.
+
+#ifndef NESVEC_H
+#define NESVEC_H
+
+#include <stdint.h>
+
+#define NESVEC_FRAME_BYTES (256 * 240 * 4)
+#define NESVEC_RAM_BYTES 0x800
+
+// the library is built with hidden visibility so the core can be inlined
+#ifdef __GNUC__
+#define NESVEC_API __attribute__((visibility("default")))
+#else
+#define NESVEC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NesVecEnv NesVecEnv;
+
+// null if the ROM can't be loaded. threads includes the calling thread
+NESVEC_API NesVecEnv* nesvec_create(const char* rom, int count, int threads);
+NESVEC_API void nesvec_destroy(NesVecEnv*);
+
+// frames each action is held for (only the last is drawn), and the episode
+// length in frames, 0 for no limit. both default to 4 and 0
+NESVEC_API void nesvec_configure(NesVecEnv*, int action_repeat, uint32_t max_episode_frames);
+
+// nonzero to run instances 16 at a time through one interpreter, which is
+// faster when they mostly run the same code. results are the same either way
+NESVEC_API void nesvec_set_lockstep(NesVecEnv*, int enabled);
+
+NESVEC_API void nesvec_reset(NesVecEnv*, uint8_t* frames, uint8_t* ram);
+NESVEC_API void nesvec_step(NesVecEnv*, const uint8_t* actions, uint8_t* frames, uint8_t* ram,
+                            uint8_t* done);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+// small fixed pool of worker threads
+//
+// run() hands out task indices 0..tasks-1 to the workers and to the calling
+// thread, and returns once every task has finished. with zero workers the
+// caller simply runs them all. tasks are meant to be coarse (a band of rows,
+// a batch of machines), so they are handed out under the lock. the task is
+// passed to the workers as a function pointer and the callable's address,
+// which the caller keeps alive until run() returns, so a run allocates
+// nothing however much the callable captures.
+
+class WorkerPool {
+  public:
+  int size() {
+    return threads.size();
+  }
+
+  void start(int count);
+  void stop();
+
+  template <typename Task>
+  void run(int tasks, const Task& task) {
+    run_job(tasks, [](void* context, int index) { (*(const Task*) context)(index); }, (void*) &task);
+  }
+
+  private:
+  vector<thread> threads;
+  mutex lock;
+  condition_variable wake;
+  condition_variable done;
+  void (*job)(void*, int) = nullptr;
+  void* job_context = nullptr;
+  int job_tasks = 0;
+  int next_task = 0;
+  int finished = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+
+  void run_job(int, void (*)(void*, int), void*);
+  void work();
+  void take_tasks(uint64_t);
+};
+
+void WorkerPool::start(int count) {
+  stopping = false;
+  for (int i = 0; i < count; ++i) {
+    threads.push_back(thread(&WorkerPool::work, this));
+  }
+}
+
+void WorkerPool::stop() {
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (thread& worker : threads) {
+    worker.join();
+  }
+  threads.clear();
+}
+
+void WorkerPool::run_job(int tasks, void (*function)(void*, int), void* context) {
+  uint64_t current;
+  {
+    lock_guard<mutex> guard(lock);
+    job = function;
+    job_context = context;
+    job_tasks = tasks;
+    next_task = 0;
+    finished = 0;
+    current = ++generation;
+  }
+  wake.notify_all();
+  take_tasks(current);
+  unique_lock<mutex> guard(lock);
+  done.wait(guard, [this]() { return finished == job_tasks; });
+}
+
+// a worker that wakes late finds the generation moved on and takes nothing
+void WorkerPool::take_tasks(uint64_t current) {
+  unique_lock<mutex> guard(lock);
+  while (generation == current && next_task < job_tasks) {
+    int task = next_task++;
+    guard.unlock();
+    job(job_context, task);
+    guard.lock();
+    if (++finished == job_tasks) {
+      done.notify_all();
+    }
+  }
+}
+
+void WorkerPool::work() {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      unique_lock<mutex> guard(lock);
+      wake.wait(guard, [&]() { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+    }
+    take_tasks(seen);
+  }
+}